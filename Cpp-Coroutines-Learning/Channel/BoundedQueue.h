@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// 固定容量的无锁 MPMC 队列，元素直接存放在数组中，入队出队都不分配内存
+// 每个槽位的 sequence 记录该槽位当前可以被哪一轮的生产者或消费者使用
+// 槽位和下标放在堆上，下标按缓存行对齐而队列对象本身不要求超过默认的对齐，可以直接放在协程帧中
+template<typename T, size_t Capacity>
+class BoundedQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static constexpr size_t mask = Capacity - 1;
+
+    struct Storage {
+        alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+        alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+        alignas(64) Cell cells[Capacity];
+    };
+
+    std::unique_ptr<Storage> storage;
+
+public:
+
+    BoundedQueue() : storage(std::make_unique<Storage>()) {
+        for (size_t i = 0; i < Capacity; i++) {
+            storage->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(BoundedQueue&) = delete;
+
+    BoundedQueue& operator=(BoundedQueue&) = delete;
+
+    // 队列已满时返回 false
+    bool try_push(const T& value) {
+        Cell* cell;
+        auto pos = storage->enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &storage->cells[pos & mask];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (storage->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = storage->enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // 队列为空时返回 false
+    bool try_pop(T& value) {
+        Cell* cell;
+        auto pos = storage->dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &storage->cells[pos & mask];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (storage->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = storage->dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->value;
+        cell->sequence.store(pos + Capacity, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        auto pos = storage->dequeue_pos.load(std::memory_order_seq_cst);
+        return storage->cells[pos & mask].sequence.load(std::memory_order_seq_cst) != pos + 1;
+    }
+};
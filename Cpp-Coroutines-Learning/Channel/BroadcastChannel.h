@@ -0,0 +1,408 @@
+#pragma once
+#include <coroutine>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include "Executor.h"
+#include "WaiterList.h"
+
+// 订阅者落后超过缓冲区容量时的处理方式
+enum class LagPolicy {
+    // 覆盖最旧的消息，落后的订阅者跳过被覆盖的部分，跳过的数量可以通过 lagged() 查询
+    drop,
+    // 发布者挂起，直到最慢的订阅者读走最旧的消息
+    block,
+    // 断开落后的订阅者，之后它的读取抛出异常
+    disconnect,
+};
+
+template<typename ValueType>
+struct BroadcastChannel;
+
+template<typename ValueType>
+class BroadcastSubscriber;
+
+template<typename ValueType>
+struct BroadcastReadAwaiter : WaiterNode {
+    BroadcastSubscriber<ValueType>* subscriber;
+    AbstractExecutor* executor = nullptr;
+    std::shared_ptr<const ValueType> message;
+    std::coroutine_handle<> handle;
+
+    explicit BroadcastReadAwaiter(BroadcastSubscriber<ValueType>* subscriber) : subscriber(subscriber) {}
+
+    BroadcastReadAwaiter(BroadcastReadAwaiter&& other) noexcept
+        : subscriber(std::exchange(other.subscriber, nullptr)),
+        executor(std::exchange(other.executor, nullptr)),
+        message(std::move(other.message)),
+        handle(other.handle) {}
+
+    // 订阅者还有没读过的消息时直接读取，不挂起
+    bool await_ready() {
+        return subscriber->try_read(message);
+    }
+
+    bool await_suspend(std::coroutine_handle<> coroutine_handle) {
+        this->handle = coroutine_handle;
+        return !subscriber->channel->park_reader(this);
+    }
+
+    // 所有订阅者共享同一份消息
+    std::shared_ptr<const ValueType> await_resume() {
+        auto subscriber = std::exchange(this->subscriber, nullptr);
+        if (!message) {
+            // 挂起期间 Channel 被关闭
+            subscriber->channel->check_closed();
+        }
+        return std::move(message);
+    }
+
+    void resume() {
+        if (executor) {
+            executor->dispatch(handle);
+        }
+        else {
+            handle.resume();
+        }
+    }
+
+    ~BroadcastReadAwaiter() {
+        if (subscriber) subscriber->channel->remove_reader(this);
+    }
+};
+
+template<typename ValueType>
+struct BroadcastPublishAwaiter : WaiterNode {
+    BroadcastChannel<ValueType>* channel;
+    AbstractExecutor* executor = nullptr;
+    std::shared_ptr<const ValueType> message;
+    std::coroutine_handle<> handle;
+
+    BroadcastPublishAwaiter(BroadcastChannel<ValueType>* channel, std::shared_ptr<const ValueType> message)
+        : channel(channel), message(std::move(message)) {}
+
+    BroadcastPublishAwaiter(BroadcastPublishAwaiter&& other) noexcept
+        : channel(std::exchange(other.channel, nullptr)),
+        executor(std::exchange(other.executor, nullptr)),
+        message(std::move(other.message)),
+        handle(other.handle) {}
+
+    // 只有 block 策略下缓冲区被最慢的订阅者占满时才需要挂起
+    bool await_ready() {
+        return channel->try_publish_message(message);
+    }
+
+    bool await_suspend(std::coroutine_handle<> coroutine_handle) {
+        this->handle = coroutine_handle;
+        return !channel->park_publisher(this);
+    }
+
+    void await_resume() {
+        auto channel = std::exchange(this->channel, nullptr);
+        channel->check_closed();
+    }
+
+    void resume() {
+        if (executor) {
+            executor->dispatch(handle);
+        }
+        else {
+            handle.resume();
+        }
+    }
+
+    ~BroadcastPublishAwaiter() {
+        if (channel) channel->remove_publisher(this);
+    }
+};
+
+// 订阅者只能在一个协程中读取，析构时自动退订，不能比 BroadcastChannel 活得更久
+template<typename ValueType>
+class BroadcastSubscriber {
+public:
+    BroadcastSubscriber(BroadcastSubscriber&) = delete;
+
+    BroadcastSubscriber& operator=(BroadcastSubscriber&) = delete;
+
+    ~BroadcastSubscriber() {
+        channel->unsubscribe(this);
+    }
+
+    auto read() {
+        return BroadcastReadAwaiter<ValueType>(this);
+    }
+
+    // 不挂起的读取，没有新消息时返回 false
+    bool try_read(std::shared_ptr<const ValueType>& message) {
+        return channel->take(this, message);
+    }
+
+    // 因为落后而跳过的消息数量
+    size_t lagged() {
+        std::lock_guard lock(channel->channel_lock);
+        return lagged_count;
+    }
+
+    bool is_connected() {
+        std::lock_guard lock(channel->channel_lock);
+        return connected;
+    }
+
+private:
+    friend struct BroadcastChannel<ValueType>;
+    friend struct BroadcastReadAwaiter<ValueType>;
+
+    BroadcastSubscriber(BroadcastChannel<ValueType>* channel, unsigned long long cursor)
+        : channel(channel), cursor(cursor) {}
+
+    BroadcastChannel<ValueType>* channel;
+    // 下一条要读取的消息的序号
+    unsigned long long cursor;
+    size_t lagged_count = 0;
+    bool connected = true;
+};
+
+// 一对多的广播：所有订阅者共享一个环形缓冲区，每个订阅者只记录自己读到的位置
+// 发布一条消息只写入一次，订阅者读到的是同一个 shared_ptr，不会为每个订阅者复制消息
+template<typename ValueType>
+struct BroadcastChannel {
+
+    struct ChannelClosedException : std::exception {
+        const char* what() const noexcept override {
+            return "Channel is closed.";
+        }
+    };
+
+    struct SubscriberDisconnectedException : std::exception {
+        const char* what() const noexcept override {
+            return "Subscriber is disconnected.";
+        }
+    };
+
+    explicit BroadcastChannel(size_t capacity, LagPolicy policy = LagPolicy::drop)
+        : ring(std::max<size_t>(capacity, 1)), capacity(std::max<size_t>(capacity, 1)), policy(policy) {
+        _is_active.store(true, std::memory_order_relaxed);
+    }
+
+    BroadcastChannel(BroadcastChannel&) = delete;
+
+    BroadcastChannel& operator=(BroadcastChannel&) = delete;
+
+    ~BroadcastChannel() {
+        close();
+    }
+
+    void check_closed() {
+        if (!_is_active.load(std::memory_order_relaxed)) {
+            throw ChannelClosedException();
+        }
+    }
+
+    bool is_active() {
+        return _is_active.load(std::memory_order_relaxed);
+    }
+
+    // 订阅者只会收到订阅之后发布的消息
+    std::unique_ptr<BroadcastSubscriber<ValueType>> subscribe() {
+        std::lock_guard lock(channel_lock);
+        check_closed();
+        auto subscriber = std::unique_ptr<BroadcastSubscriber<ValueType>>(new BroadcastSubscriber<ValueType>(this, tail));
+        subscribers.push_back(subscriber.get());
+        return subscriber;
+    }
+
+    auto publish(ValueType value) {
+        check_closed();
+        return BroadcastPublishAwaiter<ValueType>(this, std::make_shared<const ValueType>(std::move(value)));
+    }
+
+    // 不挂起的发布，block 策略下缓冲区已满时返回 false
+    bool try_publish(ValueType value) {
+        auto message = std::make_shared<const ValueType>(std::move(value));
+        return try_publish_message(message);
+    }
+
+    void close() {
+        bool expect = true;
+        if (_is_active.compare_exchange_strong(expect, false, std::memory_order_relaxed)) {
+            clean_up();
+        }
+    }
+
+    // 以下供 awaiter 和订阅者使用
+
+    bool try_publish_message(std::shared_ptr<const ValueType>& message) {
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        if (is_full()) {
+            return false;
+        }
+        WakeList<BroadcastReadAwaiter<ValueType>> woken;
+        publish_locked(std::move(message), woken);
+        lock.unlock();
+
+        woken.resume_all();
+        return true;
+    }
+
+    bool park_publisher(BroadcastPublishAwaiter<ValueType>* publish_awaiter) {
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        if (!is_full()) {
+            WakeList<BroadcastReadAwaiter<ValueType>> woken;
+            publish_locked(std::move(publish_awaiter->message), woken);
+            lock.unlock();
+
+            woken.resume_all();
+            return true;
+        }
+        publisher_list.push_back(publish_awaiter);
+        return false;
+    }
+
+    bool take(BroadcastSubscriber<ValueType>* subscriber, std::shared_ptr<const ValueType>& message) {
+        std::unique_lock lock(channel_lock);
+        return take_locked(lock, subscriber, message);
+    }
+
+    bool park_reader(BroadcastReadAwaiter<ValueType>* reader_awaiter) {
+        std::unique_lock lock(channel_lock);
+        if (take_locked(lock, reader_awaiter->subscriber, reader_awaiter->message)) {
+            return true;
+        }
+        reader_list.push_back(reader_awaiter);
+        return false;
+    }
+
+    void remove_reader(BroadcastReadAwaiter<ValueType>* reader_awaiter) {
+        std::lock_guard lock(channel_lock);
+        reader_list.remove(reader_awaiter);
+    }
+
+    void remove_publisher(BroadcastPublishAwaiter<ValueType>* publish_awaiter) {
+        std::lock_guard lock(channel_lock);
+        publisher_list.remove(publish_awaiter);
+    }
+
+    void unsubscribe(BroadcastSubscriber<ValueType>* subscriber) {
+        std::unique_lock lock(channel_lock);
+        detach_locked(subscriber);
+        // 退订的可能是最慢的订阅者
+        WakeList<BroadcastReadAwaiter<ValueType>> woken_readers;
+        WakeList<BroadcastPublishAwaiter<ValueType>> woken_publishers;
+        drain_publishers_locked(woken_readers, woken_publishers);
+        lock.unlock();
+
+        woken_readers.resume_all();
+        woken_publishers.resume_all();
+    }
+
+private:
+    friend class BroadcastSubscriber<ValueType>;
+
+    std::vector<std::shared_ptr<const ValueType>> ring;
+    size_t capacity;
+    LagPolicy policy;
+    // 下一条消息的序号，序号为 n 的消息保存在 ring[n % capacity]
+    unsigned long long tail = 0;
+    // 所有订阅者中最小的读取位置的下界，读取位置只增不减，只有看起来已满时才重新计算
+    unsigned long long min_cursor = 0;
+
+    std::vector<BroadcastSubscriber<ValueType>*> subscribers;
+    // 已经读完所有消息、等待下一条消息的订阅者
+    WaiterList<BroadcastReadAwaiter<ValueType>> reader_list;
+    // block 策略下等待最慢的订阅者的发布者
+    WaiterList<BroadcastPublishAwaiter<ValueType>> publisher_list;
+
+    std::atomic<bool> _is_active;
+    std::mutex channel_lock;
+
+    bool is_full() {
+        if (policy != LagPolicy::block || tail - min_cursor < capacity) {
+            return false;
+        }
+        min_cursor = tail;
+        for (auto subscriber : subscribers) {
+            min_cursor = std::min(min_cursor, subscriber->cursor);
+        }
+        return tail - min_cursor >= capacity;
+    }
+
+    // 写入一条消息，直接交给所有等待的订阅者，它们一定已经读完了之前的消息
+    void publish_locked(std::shared_ptr<const ValueType>&& message, WakeList<BroadcastReadAwaiter<ValueType>>& woken) {
+        ring[tail % capacity] = std::move(message);
+        tail++;
+        while (auto reader = reader_list.pop_front()) {
+            reader->message = ring[reader->subscriber->cursor % capacity];
+            reader->subscriber->cursor++;
+            woken.push_back(reader);
+        }
+    }
+
+    bool take_locked(std::unique_lock<std::mutex>& lock, BroadcastSubscriber<ValueType>* subscriber,
+        std::shared_ptr<const ValueType>& message) {
+        check_closed();
+        if (!subscriber->connected) {
+            throw SubscriberDisconnectedException();
+        }
+        auto oldest = tail > capacity ? tail - capacity : 0;
+        if (subscriber->cursor < oldest) {
+            // 没有读过的消息已经被覆盖
+            if (policy == LagPolicy::disconnect) {
+                detach_locked(subscriber);
+                throw SubscriberDisconnectedException();
+            }
+            subscriber->lagged_count += oldest - subscriber->cursor;
+            subscriber->cursor = oldest;
+        }
+        if (subscriber->cursor == tail) {
+            return false;
+        }
+        message = ring[subscriber->cursor % capacity];
+        subscriber->cursor++;
+        if (!publisher_list.empty()) {
+            WakeList<BroadcastReadAwaiter<ValueType>> woken_readers;
+            WakeList<BroadcastPublishAwaiter<ValueType>> woken_publishers;
+            drain_publishers_locked(woken_readers, woken_publishers);
+            lock.unlock();
+
+            woken_readers.resume_all();
+            woken_publishers.resume_all();
+        }
+        return true;
+    }
+
+    // 缓冲区空出位置之后依次写入等待的发布者的消息
+    void drain_publishers_locked(WakeList<BroadcastReadAwaiter<ValueType>>& woken_readers,
+        WakeList<BroadcastPublishAwaiter<ValueType>>& woken_publishers) {
+        while (!publisher_list.empty() && !is_full()) {
+            auto publisher = publisher_list.pop_front();
+            publish_locked(std::move(publisher->message), woken_readers);
+            woken_publishers.push_back(publisher);
+        }
+    }
+
+    void detach_locked(BroadcastSubscriber<ValueType>* subscriber) {
+        subscriber->connected = false;
+        std::erase(subscribers, subscriber);
+    }
+
+    void clean_up() {
+        std::unique_lock lock(channel_lock);
+        WakeList<BroadcastReadAwaiter<ValueType>> readers;
+        while (auto reader = reader_list.pop_front()) {
+            readers.push_back(reader);
+        }
+        WakeList<BroadcastPublishAwaiter<ValueType>> publishers;
+        while (auto publisher = publisher_list.pop_front()) {
+            publishers.push_back(publisher);
+        }
+        lock.unlock();
+
+        readers.resume_all();
+        publishers.resume_all();
+    }
+};
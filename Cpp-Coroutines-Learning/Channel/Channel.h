@@ -1,9 +1,18 @@
 #pragma once
 #include <coroutine>
 #include "ChannelAwaiter.h"
+#include "ChannelRing.h"
+#include "TimeoutAwaiter.h"
 #include <exception>
-
-template<typename ValueType>
+#include <optional>
+#include <span>
+#include <vector>
+
+//  Channel ʹĻλݻпλʱд
+// ֻҪ߻ѵȴʱŽ·Ϊ 0 ʱд˫·ֱӽ
+// Policy ͬʱдЭSpscPolicyMpscPolicy  MpmcPolicy
+// д˫ͬһ LooperExecutor ʱʹ LocalPolicy·ȴ dispatch ڵǰֱ߳ӻָ߷Ķ
+template<typename ValueType, typename Policy>
 struct Channel {
 
     struct ChannelClosedException : std::exception {
@@ -18,96 +27,268 @@ struct Channel {
         }
     }
 
-    void try_push_reader(ReaderAwaiter<ValueType>* reader_awaiter) {
-        std::unique_lock lock(channel_lock);
-        check_closed();
-
-        if (!buffer.empty()) {
-            auto value = buffer.front();
-            buffer.pop();
-
-            if (!writer_list.empty()) {
-                auto writer = writer_list.front();
-                writer_list.pop_front();
-                buffer.push(writer->_value);
-                lock.unlock();
-
-                writer->resume();
-            }
-            else {
-                lock.unlock();
-            }
+    // Ŀ·ݲûйдʱֱȡ
+    //  await_ready ãɹʱЭ̲Ҳ
+    std::optional<ValueType> fast_read() {
+        if (!buffer || !is_active() || waiting_writers.load(std::memory_order_relaxed) != 0) {
+            return std::nullopt;
+        }
+        auto value = buffer->try_pop();
+        if (value) {
+            on_popped();
+        }
+        return value;
+    }
 
-            reader_awaiter->resume(value);
-            return;
+    // Ŀ·пλûйĶȡʱֱд룬ɹʱ value ƶ
+    bool fast_write(ValueType& value) {
+        if (!buffer || !is_active() || waiting_readers.load(std::memory_order_relaxed) != 0 || !buffer->try_push(std::move(value))) {
+            return false;
         }
+        on_pushed();
+        return true;
+    }
 
-        if (!writer_list.empty()) {
-            auto writer = writer_list.front();
-            writer_list.pop_front();
-            lock.unlock();
+    //  true ʾȡѾɣǰЭ̲Ҫ
+    bool try_push_reader(ReaderAwaiter<ValueType, Policy>* reader_awaiter) {
+        check_closed();
+        if (auto value = fast_read()) {
+            reader_awaiter->set_value(std::move(*value));
+            return true;
+        }
+        return park_reader(reader_awaiter);
+    }
 
-            reader_awaiter->resume(writer->_value);
-            writer->resume();
-            return;
+    //  true ʾдѾɣǰЭ̲Ҫ
+    bool try_push_writer(WriterAwaiter<ValueType, Policy>* writer_awaiter) {
+        check_closed();
+        if (fast_write(writer_awaiter->_value)) {
+            return true;
         }
+        return park_writer(writer_awaiter);
+    }
 
-        reader_list.push_back(reader_awaiter);
+    // ĶȡЭ֮Ĵʹãûݲûйдʱ false
+    bool try_read(ValueType& value) {
+        check_closed();
+        if (auto taken = fast_read()) {
+            value = std::move(*taken);
+            return true;
+        }
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        return take_locked(lock, 1, [&](ValueType& taken) { value = std::move(taken); }) > 0;
     }
 
-    void try_push_writer(WriterAwaiter<ValueType>* writer_awaiter) {
+    // д룬Э֮ĴʹãûйĶȡʱ false
+    bool try_write(ValueType value) {
+        check_closed();
+        if (fast_write(value)) {
+            return true;
+        }
         std::unique_lock lock(channel_lock);
         check_closed();
-        if (!reader_list.empty()) {
-            auto reader = reader_list.front();
-            reader_list.pop_front();
-            lock.unlock();
+        return give_locked(lock, &value, 1) > 0;
+    }
 
-            reader->resume(writer_awaiter->_value);
-            writer_awaiter->resume();
-            return;
+    // д룬пλʱֱڲλйֵκм
+    template<typename... Args>
+    bool try_emplace(Args&&... args) {
+        check_closed();
+        if (buffer && is_active() && waiting_readers.load(std::memory_order_relaxed) == 0 && buffer->try_push(std::forward<Args>(args)...)) {
+            on_pushed();
+            return true;
         }
+        return try_write(ValueType(std::forward<Args>(args)...));
+    }
 
-        if (buffer.size() < buffer_capacity) {
-            buffer.push(writer_awaiter->_value);
-            lock.unlock();
-            writer_awaiter->resume();
-            return;
+    // ȡ max_n ֵ׷ӵ outȡ
+    // еݲȡճλһμвд
+    size_t try_read_batch(std::vector<ValueType>& out, size_t max_n) {
+        check_closed();
+        if (buffer && waiting_writers.load(std::memory_order_relaxed) == 0) {
+            auto count = buffer->try_pop_n(out, max_n);
+            if (count > 0) {
+                on_popped(count);
+            }
+            return count;
         }
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        return take_locked(lock, max_n, [&](ValueType& value) { out.push_back(std::move(value)); });
+    }
 
-        writer_list.push_back(writer_awaiter);
+    // д values оֵܶд
+    // Ķȡһдɺͳһ
+    size_t try_write_batch(std::span<const ValueType> values) {
+        check_closed();
+        if (buffer && waiting_readers.load(std::memory_order_relaxed) == 0) {
+            auto count = buffer->try_push_n(values.data(), values.size());
+            if (count > 0) {
+                on_pushed(count);
+            }
+            return count;
+        }
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        return give_locked(lock, values.data(), values.size());
     }
 
-    void remove_writer(WriterAwaiter<ValueType>* writer_awaiter) {
+    //  true ʾȴ߻бвѾƳ
+    bool remove_writer(WriterAwaiter<ValueType, Policy>* writer_awaiter) {
         std::lock_guard lock(channel_lock);
-        auto size = writer_list.remove(writer_awaiter);
-        debug("remove writer ", size);
+        auto removed = writer_list.remove(writer_awaiter);
+        waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+        return removed;
     }
 
-    void remove_reader(ReaderAwaiter<ValueType>* reader_awaiter) {
+    bool remove_reader(ReaderAwaiter<ValueType, Policy>* reader_awaiter) {
         std::lock_guard lock(channel_lock);
-        auto size = reader_list.remove(reader_awaiter);
-        debug("remove reader ", size);
+        auto removed = reader_list.remove(reader_awaiter);
+        waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+        return removed;
+    }
+
+    // select Ķȡ֧ Channel Ѿرʱ֧ʤ true
+    // Ǽǵȴ falseselect Ѿ֧ʱٵǼǣͬ false
+    bool select_reader(ReaderAwaiter<ValueType, Policy>* reader_awaiter) {
+        std::unique_lock lock(channel_lock);
+        while (reader_awaiter->acquire()) {
+            if (!is_active()) {
+                reader_awaiter->commit();
+                return true;
+            }
+            if (buffer) {
+                waiting_readers.store(reader_list.size() + 1, std::memory_order_relaxed);
+                fence();
+            }
+            std::optional<ValueType> value;
+            if (buffer) {
+                value = buffer->try_pop();
+            }
+            if (value) {
+                reader_awaiter->set_value(std::move(*value));
+                reader_awaiter->commit();
+                waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+                lock.unlock();
+                on_popped();
+                return true;
+            }
+            WriterAwaiter<ValueType, Policy>* contended = nullptr;
+            if (auto writer = try_acquire_peer(writer_list, reader_awaiter->select, contended)) {
+                reader_awaiter->set_value(std::move(writer->_value));
+                writer->commit();
+                reader_awaiter->commit();
+                writer_list.remove(writer);
+                waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+                waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+                lock.unlock();
+                writer->resume();
+                return true;
+            }
+            if (!contended) {
+                reader_list.push_back(reader_awaiter);
+                waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+                reader_awaiter->rollback();
+                return false;
+            }
+            reader_awaiter->rollback();
+            contended->select->wait_idle();
+        }
+        return false;
+    }
+
+    // select дֵ֧ select_reader ͬ
+    bool select_writer(WriterAwaiter<ValueType, Policy>* writer_awaiter) {
+        std::unique_lock lock(channel_lock);
+        while (writer_awaiter->acquire()) {
+            if (!is_active()) {
+                writer_awaiter->commit();
+                return true;
+            }
+            ReaderAwaiter<ValueType, Policy>* contended = nullptr;
+            if (auto reader = try_acquire_peer(reader_list, writer_awaiter->select, contended)) {
+                reader->set_value(std::move(writer_awaiter->_value));
+                reader->commit();
+                writer_awaiter->commit();
+                reader_list.remove(reader);
+                waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+                lock.unlock();
+                reader->resume();
+                return true;
+            }
+            if (!contended) {
+                if (buffer) {
+                    waiting_writers.store(writer_list.size() + 1, std::memory_order_relaxed);
+                    fence();
+                }
+                if (buffer && buffer->try_push(std::move(writer_awaiter->_value))) {
+                    writer_awaiter->commit();
+                    waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+                    lock.unlock();
+                    on_pushed();
+                    return true;
+                }
+                writer_list.push_back(writer_awaiter);
+                waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+                writer_awaiter->rollback();
+                return false;
+            }
+            writer_awaiter->rollback();
+            contended->select->wait_idle();
+        }
+        return false;
     }
 
     auto write(ValueType value) {
         check_closed();
-        return WriterAwaiter<ValueType>(this, value);
+        return WriterAwaiter<ValueType, Policy>(this, std::move(value));
+    }
+
+    // ֱòдֵֻ֮ᱻƶ
+    template<typename... Args>
+    auto emplace(Args&&... args) {
+        check_closed();
+        return WriterAwaiter<ValueType, Policy>(this, std::in_place, std::forward<Args>(args)...);
     }
 
     auto operator<<(ValueType value) {
-        return write(value);
+        return write(std::move(value));
     }
 
     auto read() {
         check_closed();
-        return ReaderAwaiter<ValueType>(this);
+        return ReaderAwaiter<ValueType, Policy>(this);
+    }
+
+    // ʱ std::nullopt
+    template<typename _Rep, typename _Period>
+    auto read_for(std::chrono::duration<_Rep, _Period> duration) {
+        return with_timeout(read(), duration);
+    }
+
+    // ʱ falseֵûд Channel
+    template<typename _Rep, typename _Period>
+    auto write_for(ValueType value, std::chrono::duration<_Rep, _Period> duration) {
+        return with_timeout(write(std::move(value)), duration);
+    }
+
+    // д values еֵʱȫд֮Żָ
+    // values õ co_await ֮ǰ뱣Ч
+    auto write_batch(std::span<const ValueType> values) {
+        check_closed();
+        return WriteBatchAwaiter<ValueType, Policy>(this, values);
+    }
+
+    // ٶȡһֵ max_n ׷ӵ out Уضȡ
+    auto read_batch(std::vector<ValueType>& out, size_t max_n) {
+        check_closed();
+        return ReadBatchAwaiter<ValueType, Policy>(this, out, max_n);
     }
 
     auto operator>>(ValueType& value_ref) {
-        auto awaiter = read();
-        awaiter.p_value = &value_ref;
-        return awaiter;
+        check_closed();
+        return ReadIntoAwaiter<ValueType, Policy>(this, value_ref);
     }
 
     void close() {
@@ -118,6 +299,9 @@ struct Channel {
     }
 
     explicit Channel(int capacity = 0) : buffer_capacity(capacity) {
+        if (capacity > 0) {
+            buffer = std::make_unique<ChannelRing<ValueType, Policy>>(capacity);
+        }
         _is_active.store(true, std::memory_order_relaxed);
     }
 
@@ -132,39 +316,291 @@ struct Channel {
     Channel& operator=(Channel&) = delete;
 
     ~Channel() {
+        if constexpr (!Policy::multi_thread) {
+            channel_lock.rebind();
+        }
         close();
     }
 
 private:
     // buffer 
     int buffer_capacity;
-    std::queue<ValueType> buffer;
+    // Ϊ 0 ʱΪ
+    std::unique_ptr<ChannelRing<ValueType, Policy>> buffer;
     // buffer ʱдҪ𱣴ȴָ
-    std::list<WriterAwaiter<ValueType>*> writer_list;
+    // ڵǶ awaiter У𡢻Ѻͳ O(1) Ҳڴ
+    WaiterList<WriterAwaiter<ValueType, Policy>> writer_list;
     // buffer ΪʱĶȡҪ𱣴ȴָ
-    std::list<ReaderAwaiter<ValueType>*> reader_list;
+    WaiterList<ReaderAwaiter<ValueType, Policy>> reader_list;
+    // бĳȣֻڳʱ޸ģ·ȡжǷҪ·ѵȴ
+    std::atomic<size_t> waiting_writers{ 0 };
+    std::atomic<size_t> waiting_readers{ 0 };
     // Channel ״̬ʶ
     std::atomic<bool> _is_active;
 
-    std::mutex channel_lock;
+    // LocalPolicy ʱǲκĿ
+    ChannelMutex<Policy> channel_lock;
     std::condition_variable channel_condition;
 
-    void clean_up() {
-        std::lock_guard lock(channel_lock);
+    // ͻѵͬʽһȵǼǵȴϸ黺һȶдϸȴ
+    // һܿԷֵȴ߹֮󻺳ı仯˴
 
-        // ҪѾȴЭԻִָ
-        for (auto writer : writer_list) {
-            writer->resume();
+    // ֻһ߳ʹʱҪϣ԰汾мͬһ߳
+    void fence() {
+        if constexpr (Policy::multi_thread) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        else {
+            channel_lock.check_thread();
+        }
+    }
+
+    // ׵һԻѵĵȴߣѾϵ select ֱ֧Ƴ
+    template<typename Awaiter>
+    Awaiter* acquire_front(WaiterList<Awaiter>& list) {
+        while (auto waiter = list.front()) {
+            if (waiter->acquire()) {
+                return waiter;
+            }
+            list.pop_front();
+        }
+        return nullptr;
+    }
+
+    // select ǼǷ֧ʱʹãԼ״̬Ѿٵȴ״ֻ̬һ
+    // ͬһ select ֧ڱ̳߳Եĵȴʱͨ contended ɵ߷ſԼ״̬֮ٵȴ
+    template<typename Awaiter>
+    Awaiter* try_acquire_peer(WaiterList<Awaiter>& list, SelectState* self, Awaiter*& contended) {
+        auto waiter = list.front();
+        while (waiter) {
+            auto next = list.next(waiter);
+            if (!waiter->select) {
+                return waiter;
+            }
+            if (waiter->select != self) {
+                auto state = waiter->select->try_acquire();
+                if (state == SelectState::open) {
+                    return waiter;
+                }
+                if (state == SelectState::busy) {
+                    contended = waiter;
+                    return nullptr;
+                }
+                list.remove(waiter);
+            }
+            waiter = next;
+        }
+        return nullptr;
+    }
+
+    // ʱȡ max_n ֵ consumeȴӻȡÿճһλþͰһдߵֵȥ
+    // ΪʱֱӴӹдȡȡֵʱͷͳһָӦдߣһûȡʱȻ
+    template<typename Consume>
+    size_t take_locked(std::unique_lock<ChannelMutex<Policy>>& lock, size_t max_n, Consume&& consume) {
+        WakeList<WriterAwaiter<ValueType, Policy>> woken;
+        size_t count = 0;
+        while (count < max_n) {
+            std::optional<ValueType> value;
+            if (buffer) {
+                value = buffer->try_pop();
+            }
+            if (value) {
+                if (auto writer = acquire_front(writer_list)) {
+                    if (buffer->try_push(std::move(writer->_value))) {
+                        writer->commit();
+                        woken.push_back(writer_list.pop_front());
+                    }
+                    else {
+                        writer->rollback();
+                    }
+                }
+            }
+            else if (auto writer = acquire_front(writer_list)) {
+                value.emplace(std::move(writer->_value));
+                writer->commit();
+                woken.push_back(writer_list.pop_front());
+            }
+            else {
+                break;
+            }
+            consume(*value);
+            count++;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+        waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+        lock.unlock();
+
+        woken.resume_all();
+        return count;
+    }
+
+    // ʱд values еǰ n ֵȽĶȡߣķ뻺
+    // дֵʱͷͳһָȡߣһûдʱȻ
+    // values ָ const ʱƣƶûдֲֵ
+    template<typename T>
+    size_t give_locked(std::unique_lock<ChannelMutex<Policy>>& lock, T* values, size_t n) {
+        WakeList<ReaderAwaiter<ValueType, Policy>> woken;
+        size_t count = 0;
+        while (count < n) {
+            auto reader = acquire_front(reader_list);
+            if (!reader) {
+                break;
+            }
+            reader->set_value(std::move(values[count++]));
+            reader->commit();
+            woken.push_back(reader_list.pop_front());
+        }
+        while (count < n && buffer && buffer->try_push(std::move(values[count]))) {
+            count++;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+        waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+        lock.unlock();
+
+        woken.resume_all();
+        return count;
+    }
+
+    // ·ȵǼǵȴټһΣȻûݾ͹
+    bool park_reader(ReaderAwaiter<ValueType, Policy>* reader_awaiter) {
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        if (buffer) {
+            waiting_readers.store(reader_list.size() + 1, std::memory_order_relaxed);
+            fence();
+        }
+        if (!buffer) {
+            // ûлʱֱӴӹднӹֵм
+            if (auto writer = acquire_front(writer_list)) {
+                reader_awaiter->set_value(std::move(writer->_value));
+                writer->commit();
+                writer_list.pop_front();
+                waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+                lock.unlock();
+
+                writer->resume();
+                return true;
+            }
+        }
+        else if (take_locked(lock, 1, [&](ValueType& value) { reader_awaiter->set_value(std::move(value)); })) {
+            return true;
+        }
+
+        reader_list.push_back(reader_awaiter);
+        waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+        return false;
+    }
+
+    // ·йĶȡʱֱӽȵǼǵȴټһλȻûпλ͹
+    bool park_writer(WriterAwaiter<ValueType, Policy>* writer_awaiter) {
+        std::unique_lock lock(channel_lock);
+        check_closed();
+        if (buffer && reader_list.empty()) {
+            waiting_writers.store(writer_list.size() + 1, std::memory_order_relaxed);
+            fence();
+        }
+        if (give_locked(lock, &writer_awaiter->_value, 1)) {
+            return true;
         }
-        writer_list.clear();
 
-        for (auto reader : reader_list) {
-            reader->resume();
+        writer_list.push_back(writer_awaiter);
+        waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+        return false;
+    }
+
+    // ȡ count ݣйдʱǵֵճλ
+    // λ·ϵдռʱҪٴ֮Ķȡٴμ
+    void on_popped(size_t count = 1) {
+        fence();
+        if (waiting_writers.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        std::unique_lock lock(channel_lock);
+        WakeList<WriterAwaiter<ValueType, Policy>> woken;
+        while (count > 0) {
+            auto writer = acquire_front(writer_list);
+            if (!writer) {
+                break;
+            }
+            if (!buffer->try_push(std::move(writer->_value))) {
+                writer->rollback();
+                break;
+            }
+            writer->commit();
+            woken.push_back(writer_list.pop_front());
+            count--;
+        }
+        waiting_writers.store(writer_list.size(), std::memory_order_relaxed);
+        if (woken.empty()) {
+            return;
         }
-        reader_list.clear();
+        lock.unlock();
 
-        //  buffer
-        decltype(buffer) empty_buffer;
-        std::swap(buffer, empty_buffer);
+        woken.resume_all();
+    }
+
+    // д count ݣйĶȡʱȡݽ
+    void on_pushed(size_t count = 1) {
+        fence();
+        if (waiting_readers.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        std::unique_lock lock(channel_lock);
+        WakeList<ReaderAwaiter<ValueType, Policy>> woken;
+        while (count > 0) {
+            auto reader = acquire_front(reader_list);
+            if (!reader) {
+                break;
+            }
+            auto value = buffer->try_pop();
+            if (!value) {
+                reader->rollback();
+                break;
+            }
+            reader->set_value(std::move(*value));
+            reader->commit();
+            woken.push_back(reader_list.pop_front());
+            count--;
+        }
+        waiting_readers.store(reader_list.size(), std::memory_order_relaxed);
+        if (woken.empty()) {
+            return;
+        }
+        lock.unlock();
+
+        on_popped(woken.size());
+        woken.resume_all();
+    }
+
+    void clean_up() {
+        std::unique_lock lock(channel_lock);
+        // Ѿϵ select ֧ٻָ
+        WakeList<WriterAwaiter<ValueType, Policy>> writers;
+        while (auto writer = acquire_front(writer_list)) {
+            writer->commit();
+            writers.push_back(writer_list.pop_front());
+        }
+        waiting_writers.store(0, std::memory_order_relaxed);
+        WakeList<ReaderAwaiter<ValueType, Policy>> readers;
+        while (auto reader = acquire_front(reader_list)) {
+            reader->commit();
+            readers.push_back(reader_list.pop_front());
+        }
+        waiting_readers.store(0, std::memory_order_relaxed);
+
+        // buffer ʣ Channel һر֮Ķд׳쳣
+        // ﲻٳӣͿ·ϵĶȡͬʱ
+        lock.unlock();
+
+        // ҪѾȴЭԻִָ
+        // ֱָڵǰ߳ϽУҪͷ
+        writers.resume_all();
+        readers.resume_all();
     }
 };
\ No newline at end of file
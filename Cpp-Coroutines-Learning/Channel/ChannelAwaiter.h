@@ -1,32 +1,123 @@
 #pragma once
 #include<coroutine>
-template<typename ValueType>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <span>
+#include <vector>
+#include "Executor.h"
+#include "ChannelRing.h"
+#include "WaiterList.h"
+
+template<typename ValueType, typename Policy = MpmcPolicy>
 struct Channel;
 
-template<typename ValueType>
-struct WriterAwaiter {
-    Channel<ValueType>* channel;
+// select 的各个分支共享的状态，第一个完成的分支获胜，其余分支作废
+// 完成一个分支之前先把状态锁定为 busy，操作失败时恢复为 open，其他线程看到 busy 时等待结果
+// 持有 busy 状态的线程不会再等待其他状态，所以不会出现循环等待
+struct SelectState {
+    static constexpr int open = -1;
+    static constexpr int busy = -2;
+
+    // 获胜分支的下标
+    std::atomic<int> winner{ open };
+    // 登记完所有分支和分支完成各计一次，后到的一方负责恢复协程
+    std::atomic<int> arrivals{ 0 };
+    std::coroutine_handle<> handle;
+    AbstractExecutor* executor = nullptr;
+
+    // 锁定状态，已经有分支获胜时返回 false，其他线程正在尝试时等待它的结果
+    bool acquire() {
+        while (true) {
+            auto state = try_acquire();
+            if (state != busy) {
+                return state == open;
+            }
+            wait_idle();
+        }
+    }
+
+    // 不等待的版本：锁定成功返回 open，其他线程正在尝试返回 busy，否则返回获胜的分支
+    int try_acquire() {
+        int expected = open;
+        if (winner.compare_exchange_strong(expected, busy, std::memory_order_acquire, std::memory_order_acquire)) {
+            return open;
+        }
+        return expected;
+    }
+
+    void wait_idle() {
+        while (winner.load(std::memory_order_acquire) == busy) {
+            std::this_thread::yield();
+        }
+    }
+
+    void commit(int index) {
+        winner.store(index, std::memory_order_release);
+    }
+
+    void rollback() {
+        winner.store(open, std::memory_order_release);
+    }
+
+    // 返回 true 表示另一方已经到达，由调用者恢复协程
+    bool arrive() {
+        return arrivals.fetch_add(1, std::memory_order_acq_rel) == 1;
+    }
+
+    void wake() {
+        if (!arrive()) {
+            return;
+        }
+        if (executor) {
+            executor->dispatch(handle);
+        }
+        else {
+            handle.resume();
+        }
+    }
+};
+
+template<typename ValueType, typename Policy = MpmcPolicy>
+struct WriterAwaiter : WaiterNode {
+    Channel<ValueType, Policy>* channel;
     AbstractExecutor* executor = nullptr;
     ValueType _value;
     std::coroutine_handle<> handle;
+    // 设置时值被取走后调用它而不是恢复协程，批量写入用它继续写入剩余的值
+    void (*on_consumed)(WriterAwaiter*) = nullptr;
+    // 作为 select 的分支时指向共享的状态
+    SelectState* select = nullptr;
+    int select_index = 0;
+
+    WriterAwaiter(Channel<ValueType, Policy>* channel, ValueType value)
+        : channel(channel), _value(std::move(value)) {}
 
-    WriterAwaiter(Channel<ValueType>* channel, ValueType value)
-        : channel(channel), _value(value) {}
+    template<typename... Args>
+    WriterAwaiter(Channel<ValueType, Policy>* channel, std::in_place_t, Args&&... args)
+        : channel(channel), _value(std::forward<Args>(args)...) {}
 
     WriterAwaiter(WriterAwaiter&& other) noexcept
         : channel(std::exchange(other.channel, nullptr)),
         executor(std::exchange(other.executor, nullptr)),
-        _value(other._value),
-        handle(other.handle) {}
+        _value(std::move(other._value)),
+        handle(other.handle),
+        on_consumed(other.on_consumed),
+        select(other.select),
+        select_index(other.select_index) {}
 
 
+    // 缓冲区有空位时直接写入，不挂起
     bool await_ready() {
-        return false;
+        return channel->fast_write(_value);
     }
 
-    auto await_suspend(std::coroutine_handle<> coroutine_handle) {
+    // 写入立即完成时返回 false，当前协程不挂起直接继续执行
+    // 不返回自身的句柄：GCC 只在 -O2 下把对称转移编译成尾调用，否则每次都会增加一层栈
+    bool await_suspend(std::coroutine_handle<> coroutine_handle) {
         this->handle = coroutine_handle;
-        channel->try_push_writer(this);
+        return !channel->try_push_writer(this);
     }
 
     void await_resume() {
@@ -34,9 +125,47 @@ struct WriterAwaiter {
         channel = nullptr;
     }
 
+    // 还在等待时从 Channel 中撤出，返回 true 之后不会再被恢复
+    bool cancel() {
+        if (channel && channel->remove_writer(this)) {
+            channel = nullptr;
+            return true;
+        }
+        return false;
+    }
+
+    // 唤醒之前先认领：普通的等待者总是成功，select 的分支需要锁定共享状态，之后 commit 或者 rollback
+    bool acquire() {
+        return !select || select->acquire();
+    }
+
+    void commit() {
+        if (select) {
+            select->commit(select_index);
+        }
+    }
+
+    void rollback() {
+        if (select) {
+            select->rollback();
+        }
+    }
+
     void resume() {
+        if (select) {
+            select->wake();
+            return;
+        }
+        if (on_consumed) {
+            on_consumed(this);
+            return;
+        }
+        resume_handle();
+    }
+
+    void resume_handle() {
         if (executor) {
-            executor->execute([this]() { handle.resume(); });
+            executor->dispatch(handle);
         }
         else {
             handle.resume();
@@ -48,48 +177,83 @@ struct WriterAwaiter {
     }
 };
 
-template<typename ValueType>
-struct ReaderAwaiter {
-    Channel<ValueType>* channel;
+template<typename ValueType, typename Policy = MpmcPolicy>
+struct ReaderAwaiter : WaiterNode {
+    Channel<ValueType, Policy>* channel;
     AbstractExecutor* executor = nullptr;
-    ValueType _value;
-    ValueType* p_value = nullptr;
+    // 读到的值，写入者或者缓冲区直接移动到这里
+    std::optional<ValueType> _value;
     std::coroutine_handle<> handle;
+    SelectState* select = nullptr;
+    int select_index = 0;
 
-    explicit ReaderAwaiter(Channel<ValueType>* channel) : channel(channel) {}
+    explicit ReaderAwaiter(Channel<ValueType, Policy>* channel) : channel(channel) {}
 
     ReaderAwaiter(ReaderAwaiter&& other) noexcept
         : channel(std::exchange(other.channel, nullptr)),
         executor(std::exchange(other.executor, nullptr)),
-        _value(other._value),
-        p_value(std::exchange(other.p_value, nullptr)),
-        handle(other.handle) {}
+        _value(std::move(other._value)),
+        handle(other.handle),
+        select(other.select),
+        select_index(other.select_index) {}
 
-    bool await_ready() { return false; }
+    // 缓冲区中有数据时直接读取，不挂起
+    bool await_ready() {
+        if (auto value = channel->fast_read()) {
+            set_value(std::move(*value));
+            return true;
+        }
+        return false;
+    }
 
-    auto await_suspend(std::coroutine_handle<> coroutine_handle) {
+    bool await_suspend(std::coroutine_handle<> coroutine_handle) {
         this->handle = coroutine_handle;
-        channel->try_push_reader(this);
+        return !channel->try_push_reader(this);
     }
 
-    int await_resume() {
+    ValueType await_resume() {
         auto channel = this->channel;
         this->channel = nullptr;
         channel->check_closed();
-        return _value;
+        return std::move(*_value);
     }
 
-    void resume(ValueType value) {
-        this->_value = value;
-        if (p_value) {
-            *p_value = value;
+    bool cancel() {
+        if (channel && channel->remove_reader(this)) {
+            channel = nullptr;
+            return true;
+        }
+        return false;
+    }
+
+    template<typename U>
+    void set_value(U&& value) {
+        _value.emplace(std::forward<U>(value));
+    }
+
+    bool acquire() {
+        return !select || select->acquire();
+    }
+
+    void commit() {
+        if (select) {
+            select->commit(select_index);
+        }
+    }
+
+    void rollback() {
+        if (select) {
+            select->rollback();
         }
-        resume();
     }
 
     void resume() {
+        if (select) {
+            select->wake();
+            return;
+        }
         if (executor) {
-            executor->execute([this]() { handle.resume(); });
+            executor->dispatch(handle);
         }
         else {
             handle.resume();
@@ -100,3 +264,108 @@ struct ReaderAwaiter {
         if (channel) channel->remove_reader(this);
     }
 };
+
+// 批量写入：每次无锁写入或者加锁时尽可能多地写入，挂起的读取者在一批写入完成后统一唤醒
+// 缓冲区满时把下一个值作为普通的写入者挂起，这个值被取走之后在取走它的线程上继续写入，全部写完才恢复协程
+template<typename ValueType, typename Policy = MpmcPolicy>
+struct WriteBatchAwaiter : WriterAwaiter<ValueType, Policy> {
+    std::span<const ValueType> values;
+    size_t written = 0;
+
+    WriteBatchAwaiter(Channel<ValueType, Policy>* channel, std::span<const ValueType> values)
+        : WriterAwaiter<ValueType, Policy>(channel, values.empty() ? ValueType() : values.front()), values(values) {
+        this->on_consumed = &WriteBatchAwaiter::continue_writing;
+    }
+
+    WriteBatchAwaiter(WriteBatchAwaiter&& other) noexcept
+        : WriterAwaiter<ValueType, Policy>(std::move(other)), values(other.values), written(other.written) {}
+
+    bool await_ready() {
+        written += this->channel->try_write_batch(values.subspan(written));
+        return written == values.size();
+    }
+
+    bool await_suspend(std::coroutine_handle<> coroutine_handle) {
+        this->handle = coroutine_handle;
+        return !write_rest();
+    }
+
+private:
+    // 返回 true 表示全部写完；返回 false 时已经挂起，之后随时可能在其他线程上继续，不能再访问成员
+    bool write_rest() {
+        while (true) {
+            written += this->channel->try_write_batch(values.subspan(written));
+            if (written == values.size()) {
+                return true;
+            }
+            this->_value = values[written];
+            if (!this->channel->try_push_writer(this)) {
+                return false;
+            }
+            written++;
+        }
+    }
+
+    static void continue_writing(WriterAwaiter<ValueType, Policy>* writer) {
+        auto self = static_cast<WriteBatchAwaiter*>(writer);
+        // Channel 关闭时直接恢复协程，由 await_resume 抛出异常
+        if (self->channel->is_active()) {
+            try {
+                self->written++;
+                if (!self->write_rest()) {
+                    return;
+                }
+            }
+            catch (...) {
+            }
+        }
+        self->resume_handle();
+    }
+};
+
+// 批量读取：缓冲区中有数据时不挂起，一次取出最多 max_n 个；没有数据时作为普通的读取者挂起，
+// 拿到一个值被恢复之后再不挂起地取出剩余的数据
+template<typename ValueType, typename Policy = MpmcPolicy>
+struct ReadBatchAwaiter : ReaderAwaiter<ValueType, Policy> {
+    std::vector<ValueType>* out;
+    size_t max_n;
+    size_t count = 0;
+
+    ReadBatchAwaiter(Channel<ValueType, Policy>* channel, std::vector<ValueType>& out, size_t max_n)
+        : ReaderAwaiter<ValueType, Policy>(channel), out(&out), max_n(max_n) {}
+
+    ReadBatchAwaiter(ReadBatchAwaiter&& other) noexcept
+        : ReaderAwaiter<ValueType, Policy>(std::move(other)), out(other.out), max_n(other.max_n), count(other.count) {}
+
+    bool await_ready() {
+        count = this->channel->try_read_batch(*out, max_n);
+        return count > 0 || max_n == 0;
+    }
+
+    size_t await_resume() {
+        auto channel = this->channel;
+        this->channel = nullptr;
+        channel->check_closed();
+        if (count == 0 && max_n > 0) {
+            out->push_back(std::move(*this->_value));
+            count = 1 + channel->try_read_batch(*out, max_n - 1);
+        }
+        return count;
+    }
+};
+
+// channel >> value：读到的值直接移动到 value 中
+template<typename ValueType, typename Policy = MpmcPolicy>
+struct ReadIntoAwaiter : ReaderAwaiter<ValueType, Policy> {
+    ValueType* target;
+
+    ReadIntoAwaiter(Channel<ValueType, Policy>* channel, ValueType& target)
+        : ReaderAwaiter<ValueType, Policy>(channel), target(&target) {}
+
+    ReadIntoAwaiter(ReadIntoAwaiter&& other) noexcept
+        : ReaderAwaiter<ValueType, Policy>(std::move(other)), target(other.target) {}
+
+    void await_resume() {
+        *target = ReaderAwaiter<ValueType, Policy>::await_resume();
+    }
+};
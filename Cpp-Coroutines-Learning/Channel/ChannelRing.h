@@ -0,0 +1,273 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <cstddef>
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Channel 的并发策略，只有一个生产者或者一个消费者的一端推进下标时不需要 CAS
+// multi_thread 为 false 时所有读写都必须在同一个线程上，Channel 不再加锁也不使用内存屏障
+struct SpscPolicy {
+    static constexpr bool multi_producer = false;
+    static constexpr bool multi_consumer = false;
+    static constexpr bool multi_thread = true;
+};
+
+struct MpscPolicy {
+    static constexpr bool multi_producer = true;
+    static constexpr bool multi_consumer = false;
+    static constexpr bool multi_thread = true;
+};
+
+struct MpmcPolicy {
+    static constexpr bool multi_producer = true;
+    static constexpr bool multi_consumer = true;
+    static constexpr bool multi_thread = true;
+};
+
+// 读写双方都在同一个 LooperExecutor 上的 Channel，等待者通过这个调度器恢复
+struct LocalPolicy {
+    static constexpr bool multi_producer = false;
+    static constexpr bool multi_consumer = false;
+    static constexpr bool multi_thread = false;
+};
+
+// LocalPolicy 使用的空锁，只在调试版本中检查调用都来自第一次使用它的线程并且没有重入
+class LocalMutex {
+public:
+    void lock() {
+        check_thread();
+        assert(!locked && "LocalMutex is not recursive.");
+#ifndef NDEBUG
+        locked = true;
+#endif
+    }
+
+    bool try_lock() {
+        lock();
+        return true;
+    }
+
+    void unlock() {
+#ifndef NDEBUG
+        locked = false;
+#endif
+    }
+
+    // 所有使用都已经结束，之后由当前线程接管，Channel 析构时使用
+    void rebind() {
+#ifndef NDEBUG
+        owner = std::this_thread::get_id();
+#endif
+    }
+
+    void check_thread() {
+#ifndef NDEBUG
+        if (owner == std::thread::id()) {
+            owner = std::this_thread::get_id();
+        }
+        assert(owner == std::this_thread::get_id() && "Channel with LocalPolicy used from another thread.");
+#endif
+    }
+
+private:
+#ifndef NDEBUG
+    std::thread::id owner;
+    bool locked = false;
+#endif
+};
+
+template<typename Policy>
+using ChannelMutex = std::conditional_t<Policy::multi_thread, std::mutex, LocalMutex>;
+
+// 参照 kfifo 的环形缓冲区：槽位数向上取整到 2 的幂，in 和 out 只增不减，用位与代替取模
+// 每个槽位的 sequence 记录它当前可以被哪一轮的写入或读取使用，写入的值通过它发布给读取者
+template<typename T, typename Policy>
+class ChannelRing {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    // 逻辑上的容量，不是 2 的幂时槽位数比它大
+    size_t capacity;
+
+    alignas(64) std::atomic<size_t> in{ 0 };
+    alignas(64) std::atomic<size_t> out{ 0 };
+
+public:
+
+    explicit ChannelRing(size_t capacity) : capacity(capacity) {
+        // 只有一个槽位时写入后的 sequence 和下一轮写入期望的值相同，至少需要两个
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells = std::make_unique<Cell[]>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ChannelRing(ChannelRing&) = delete;
+
+    ChannelRing& operator=(ChannelRing&) = delete;
+
+    // 缓冲区已满时返回 false，参数直接用来在槽位中构造元素，失败时不会被移动
+    template<typename... Args>
+    bool try_push(Args&&... args) {
+        Cell* cell;
+        auto pos = in.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (capacity != mask + 1 && pos - out.load(std::memory_order_acquire) >= capacity) {
+                    return false;
+                }
+                if constexpr (Policy::multi_producer) {
+                    if (in.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else {
+                    in.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = in.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value.emplace(std::forward<Args>(args)...);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 一次 CAS 占用从 in 开始连续可写的槽位，写入 values 中尽可能多的值，返回写入的数量
+    size_t try_push_n(const T* values, size_t n) {
+        size_t count = 0;
+        auto pos = in.load(std::memory_order_relaxed);
+        while (n > 0) {
+            auto limit = n;
+            if (capacity != mask + 1) {
+                auto used = pos - out.load(std::memory_order_acquire);
+                if (used >= capacity) {
+                    return 0;
+                }
+                limit = std::min(limit, capacity - used);
+            }
+            // sequence 等于下标的槽位在这一轮还没有被写入，占用之前只有推进 in 的一方会修改它
+            count = 0;
+            while (count < limit && cells[(pos + count) & mask].sequence.load(std::memory_order_acquire) == pos + count) {
+                count++;
+            }
+            if (count == 0) {
+                auto sequence = cells[pos & mask].sequence.load(std::memory_order_acquire);
+                if (static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos) < 0) {
+                    return 0;
+                }
+                pos = in.load(std::memory_order_relaxed);
+                continue;
+            }
+            if constexpr (Policy::multi_producer) {
+                if (in.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else {
+                in.store(pos + count, std::memory_order_relaxed);
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            auto& cell = cells[(pos + i) & mask];
+            cell.value.emplace(values[i]);
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // 缓冲区为空时返回 std::nullopt，元素直接从槽位中移动出来，T 不需要默认构造
+    std::optional<T> try_pop() {
+        Cell* cell;
+        auto pos = out.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if constexpr (Policy::multi_consumer) {
+                    if (out.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else {
+                    out.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return std::nullopt;
+            }
+            else {
+                pos = out.load(std::memory_order_relaxed);
+            }
+        }
+        std::optional<T> value(std::move(cell->value));
+        cell->value.reset();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return value;
+    }
+
+    // 一次 CAS 占用从 out 开始连续可读的至多 n 个槽位，把元素依次移动到 values 的末尾，返回读取的数量
+    // 占用之前先预留空间，占用之后不会因为分配内存而抛出异常，留下无法释放的槽位
+    size_t try_pop_n(std::vector<T>& values, size_t n) {
+        size_t count = 0;
+        auto pos = out.load(std::memory_order_relaxed);
+        while (n > 0) {
+            count = 0;
+            while (count < n && cells[(pos + count) & mask].sequence.load(std::memory_order_acquire) == pos + count + 1) {
+                count++;
+            }
+            if (count == 0) {
+                auto sequence = cells[pos & mask].sequence.load(std::memory_order_acquire);
+                if (static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1) < 0) {
+                    return 0;
+                }
+                pos = out.load(std::memory_order_relaxed);
+                continue;
+            }
+            values.reserve(values.size() + count);
+            if constexpr (Policy::multi_consumer) {
+                if (out.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else {
+                out.store(pos + count, std::memory_order_relaxed);
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            auto& cell = cells[(pos + i) & mask];
+            values.push_back(std::move(*cell.value));
+            cell.value.reset();
+            cell.sequence.store(pos + i + mask + 1, std::memory_order_release);
+        }
+        return count;
+    }
+};
@@ -3,11 +3,175 @@
 #include <mutex>
 #include <functional>
 #include <future>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <coroutine>
+#include <utility>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "MpscQueue.h"
+#include "BoundedQueue.h"
+#include "Scheduler.h"
+#include "TimingWheel.h"
 #include "io_utils.h"
 
+// 定义 USE_TIMING_WHEEL 时使用时间轮，否则使用二叉堆，便于对比两者的性能
+#ifdef USE_TIMING_WHEEL
+using DefaultTimerQueue = TimingWheel;
+#else
+using DefaultTimerQueue = HeapTimerQueue;
+#endif
+
+// LooperExecutor 的定时器队列
+// 时间轮的精度是 1ms，定时器会被推迟到下一个整毫秒，因此和 schedule_timer 一样，不是整毫秒的延迟放在二叉堆中
+// 时间轮的定时器 id 不超过 63 位，二叉堆中的定时器 id 加上最高位区分
+class LooperTimerQueue {
+public:
+    TimerId push(DelayedExecutable&& executable, [[maybe_unused]] std::chrono::microseconds delay) {
+#ifdef USE_TIMING_WHEEL
+        if (delay % std::chrono::milliseconds(1) != std::chrono::microseconds(0)) {
+            return precise_queue.push(std::move(executable)) | precise_bit;
+        }
+#endif
+        return queue.push(std::move(executable));
+    }
+
+    bool cancel(TimerId id) {
+#ifdef USE_TIMING_WHEEL
+        if (id & precise_bit) {
+            return precise_queue.cancel(id & ~precise_bit);
+        }
+#endif
+        return queue.cancel(id);
+    }
+
+    bool empty() const {
+#ifdef USE_TIMING_WHEEL
+        return queue.empty() && precise_queue.empty();
+#else
+        return queue.empty();
+#endif
+    }
+
+    long long next_time() const {
+#ifdef USE_TIMING_WHEEL
+        if (queue.empty()) {
+            return precise_queue.next_time();
+        }
+        if (!precise_queue.empty()) {
+            return std::min(queue.next_time(), precise_queue.next_time());
+        }
+#endif
+        return queue.next_time();
+    }
+
+    void pop_expired(long long now, std::vector<DelayedExecutable>& expired) {
+#ifdef USE_TIMING_WHEEL
+        auto begin = expired.size();
+        precise_queue.pop_expired(now, expired);
+        auto middle = expired.size();
+        queue.pop_expired(now, expired);
+        // 两个队列都有定时器到期时按到期时间排列
+        if (middle != begin && expired.size() != middle) {
+            std::stable_sort(expired.begin() + begin, expired.end(), [](auto& left, auto& right) {
+                return left.get_scheduled_time() < right.get_scheduled_time();
+                });
+        }
+#else
+        queue.pop_expired(now, expired);
+#endif
+    }
+
+    void clear() {
+        queue.clear();
+#ifdef USE_TIMING_WHEEL
+        precise_queue.clear();
+#endif
+    }
+
+private:
+    DefaultTimerQueue queue;
+#ifdef USE_TIMING_WHEEL
+    HeapTimerQueue precise_queue;
+    static constexpr TimerId precise_bit = 1ULL << 63;
+#endif
+};
+
+// 没有自己的定时器队列的调度器使用全局的 Scheduler 线程计时
+inline TimerHandle schedule_timer(std::function<void()>&& func, std::chrono::microseconds delay) {
+    // 不是整毫秒的时长交给 timerfd 实现的高精度调度器
+    if (delay % std::chrono::milliseconds(1) != std::chrono::microseconds(0)) {
+        static Scheduler<HeapTimerQueue> precise_scheduler(true);
+        return precise_scheduler.execute(std::move(func), delay);
+    }
+    static Scheduler<DefaultTimerQueue> scheduler;
+    return scheduler.execute(std::move(func), delay);
+}
+
 class AbstractExecutor {
 public:
     virtual void execute(std::function<void()>&& func) = 0;
+
+    // 恢复协程的专用路径，只传递协程句柄，不构造 std::function
+    virtual void schedule(std::coroutine_handle<> handle) {
+        execute([handle]() { handle.resume(); });
+    }
+
+    // 延迟 delay 之后在调度器上执行 func
+    // 默认由全局的 Scheduler 线程计时，到期后再提交给调度器，自己管理定时器的调度器可以覆盖
+    virtual TimerHandle execute_after(std::function<void()>&& func, std::chrono::microseconds delay) {
+        return schedule_timer([this, func = std::move(func)]() mutable {
+            execute(std::move(func));
+            }, delay);
+    }
+
+    // 协程创建时绑定的调度器，之后的恢复、定时器和 is_in_executor 都以它为准
+    // 由多个调度器组成的调度器返回其中的一个，默认就是自己
+    virtual AbstractExecutor* bind() {
+        return this;
+    }
+
+    // 当前线程是否是这个调度器的工作线程
+    virtual bool is_in_executor() const {
+        return current_executor == this;
+    }
+
+    // 当前线程是否是这个调度器自己启动的线程，在这样的线程上不能析构调度器
+    // 和 is_in_executor 不同，没有自己线程的调度器总是返回 false
+    virtual bool is_worker_thread() const {
+        return current_executor == this;
+    }
+
+    // 在工作线程上销毁持有这个调度器的协程，只在 is_worker_thread() 为 true 时调用
+    // 销毁协程会析构调度器，析构函数要 join 当前线程，因此不能立即销毁：
+    // 有自己线程的调度器让当前线程执行完这一轮任务后退出循环，再由它销毁协程
+    // 默认交给定时器线程销毁
+    virtual void reap(std::coroutine_handle<> handle) {
+        schedule_timer([handle]() { handle.destroy(); }, std::chrono::microseconds(0));
+    }
+
+    // 已经在调度器的线程上时直接恢复协程，嵌套过深或者在其他线程上时再交给调度器
+    void dispatch(std::coroutine_handle<> handle) {
+        if (inline_depth < max_inline_depth && is_in_executor()) {
+            inline_depth++;
+            handle.resume();
+            inline_depth--;
+        }
+        else {
+            schedule(handle);
+        }
+    }
+
+protected:
+    static constexpr int max_inline_depth = 16;
+
+    // 当前线程所属的调度器，由调度器的工作线程在启动时设置
+    static inline thread_local AbstractExecutor* current_executor = nullptr;
+    static inline thread_local int inline_depth = 0;
 };
 
 class NoopExecutor : public AbstractExecutor {
@@ -15,6 +179,15 @@ public:
     void execute(std::function<void()>&& func) override {
         func();
     }
+
+    void schedule(std::coroutine_handle<> handle) override {
+        handle.resume();
+    }
+
+    // 任何线程都可以直接执行
+    bool is_in_executor() const override {
+        return true;
+    }
 };
 
 class NewThreadExecutor : public AbstractExecutor {
@@ -31,76 +204,626 @@ public:
     }
 };
 
-class LooperExecutor : public AbstractExecutor {
+// 外部线程向调度器提交任务期间持有
+// 任务发布之后工作线程可能立刻执行它，使得调度器被销毁，而提交方还要唤醒工作线程，析构函数需要等所有提交方离开
+// 工作线程自己提交时调度器一定还在，不计数，避免在工作线程之间争用计数器
+class SubmitScope {
+public:
+    SubmitScope(std::atomic<int>& submitting, bool is_external) : submitting(is_external ? &submitting : nullptr) {
+        if (this->submitting) {
+            this->submitting->fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    SubmitScope(SubmitScope&) = delete;
+
+    SubmitScope& operator=(SubmitScope&) = delete;
+
+    ~SubmitScope() {
+        if (submitting) {
+            submitting->fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    // 析构函数中调用，等待正在提交的线程离开
+    static void wait_idle(std::atomic<int>& submitting) {
+        while (submitting.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<int>* submitting;
+};
+
+// 定时器由工作线程自己管理：挂起时等待到最近的到期时间，醒来后在本线程上一次执行所有到期的定时器
+class LooperExecutor : public AbstractExecutor, public TimerCanceller {
 private:
     std::condition_variable queue_condition;
+    // 只用于挂起工作线程和保护定时器队列
     std::mutex queue_lock;
-    std::queue<std::function<void()>> executable_queue;
+    MpscQueue<std::function<void()>> executable_queue;
+    // 协程句柄直接存放在定长数组中，满了才退回到 executable_queue
+    BoundedQueue<std::coroutine_handle<>, 1024> handle_queue;
 
     std::atomic<bool> is_active;
+    // 工作线程是否已经（或即将）在 queue_condition 上挂起
+    std::atomic<bool> is_sleeping{ false };
+    std::atomic<int> submitting{ 0 };
     std::thread work_thread;
+    // 等待工作线程退出循环后销毁的协程，只由工作线程访问
+    std::coroutine_handle<> reaped_handle;
+
+    LooperTimerQueue timer_queue;
+    std::vector<DelayedExecutable> expired_timers;
+    // 定时器队列中最早的到期时间，没有定时器时为最大值，工作线程不加锁读取
+    std::atomic<long long> timer_deadline{ std::numeric_limits<long long>::max() };
+
+    void update_timer_deadline() {
+        timer_deadline.store(timer_queue.empty() ? std::numeric_limits<long long>::max() : timer_queue.next_time(),
+            std::memory_order_relaxed);
+    }
+
+    size_t run_timers() {
+        auto deadline = timer_deadline.load(std::memory_order_relaxed);
+        if (deadline == std::numeric_limits<long long>::max()) {
+            return 0;
+        }
+        auto now = current_time_micros();
+        if (deadline > now) {
+            return 0;
+        }
+        {
+            std::lock_guard lock(queue_lock);
+            timer_queue.pop_expired(now, expired_timers);
+            update_timer_deadline();
+        }
+        auto count = expired_timers.size();
+        for (auto& executable : expired_timers) {
+            executable();
+        }
+        expired_timers.clear();
+        return count;
+    }
+
+    // 在持有锁时通知，析构函数拿到锁之后就不会再有线程访问 queue_condition
+    void notify_worker() {
+        std::lock_guard lock(queue_lock);
+        queue_condition.notify_one();
+    }
 
     void run_loop() {
-        while (is_active.load(std::memory_order_relaxed) || !executable_queue.empty()) {
-            std::unique_lock lock(queue_lock);
-            if (executable_queue.empty()) {
-                queue_condition.wait(lock);
-                if (executable_queue.empty()) {
-                    continue;
-                }
+        current_executor = this;
+        while (true) {
+            // 每次唤醒都把队列中的任务全部取走执行
+            size_t count = 0;
+            std::coroutine_handle<> handle;
+            while (handle_queue.try_pop(handle)) {
+                handle.resume();
+                count++;
+            }
+            count += executable_queue.drain([](auto& func) { func(); });
+            count += run_timers();
+            if (reaped_handle) {
+                break;
+            }
+            if (count > 0) {
+                continue;
             }
-            auto func = executable_queue.front();
-            executable_queue.pop();
-            lock.unlock();
 
-            func();
+            std::unique_lock lock(queue_lock);
+            auto deadline = timer_deadline.load(std::memory_order_relaxed);
+            if (!is_active.load(std::memory_order_relaxed) && deadline == std::numeric_limits<long long>::max()) {
+                break;
+            }
+            is_sleeping.store(true);
+            auto pred = [this, deadline]() {
+                return !executable_queue.empty() || !handle_queue.empty() || !is_active.load(std::memory_order_relaxed)
+                    || timer_deadline.load(std::memory_order_relaxed) < deadline;
+                };
+            if (deadline == std::numeric_limits<long long>::max()) {
+                queue_condition.wait(lock, pred);
+            }
+            else {
+                // 新加入的定时器更早到期时 pred 成立，重新计算等待时间
+                queue_condition.wait_until(lock,
+                    std::chrono::steady_clock::time_point(std::chrono::microseconds(deadline)), pred);
+            }
+            is_sleeping.store(false);
         }
         //debug("run_loop exit.");
     }
 
+    // 工作线程的入口，销毁协程时调度器随之析构，之后不能再访问任何成员
+    void run() {
+        run_loop();
+        if (auto handle = std::exchange(reaped_handle, {})) {
+            handle.destroy();
+        }
+    }
+
 public:
 
     LooperExecutor() {
         //debug("LooperExecutor()");
         is_active.store(true, std::memory_order_relaxed);
-        work_thread = std::thread(&LooperExecutor::run_loop, this);
+        work_thread = std::thread(&LooperExecutor::run, this);
     }
 
     ~LooperExecutor() {
         //debug(" ~LooperExecutor()");
         shutdown(false);
-        if (work_thread.joinable()) {
+        // 在工作线程上析构只可能来自 reap，线程随后直接退出
+        if (work_thread.get_id() == std::this_thread::get_id()) {
+            work_thread.detach();
+        }
+        else if (work_thread.joinable()) {
             work_thread.join();
         }
+        SubmitScope::wait_idle(submitting);
+        // 通知都在持有锁时发出，拿到锁之后其他线程已经不再访问 queue_condition
+        std::lock_guard lock(queue_lock);
     }
 
     void execute(std::function<void()>&& func) override {
-        std::unique_lock lock(queue_lock);
         if (is_active.load(std::memory_order_relaxed)) {
-            executable_queue.push(func);
-            lock.unlock();
+            SubmitScope scope(submitting, !is_in_executor());
+            bool was_empty = executable_queue.push(std::move(func));
+            // 只有队列由空变为非空时工作线程才可能挂起，其余情况不需要通知
+            if (was_empty && is_sleeping.load()) {
+                notify_worker();
+            }
+        }
+    }
+
+    void schedule(std::coroutine_handle<> handle) override {
+        if (!is_active.load(std::memory_order_relaxed)) {
+            return;
+        }
+        SubmitScope scope(submitting, !is_in_executor());
+        if (!handle_queue.try_push(handle)) {
+            AbstractExecutor::schedule(handle);
+            return;
+        }
+        if (is_sleeping.load()) {
+            notify_worker();
+        }
+    }
+
+    TimerHandle execute_after(std::function<void()>&& func, std::chrono::microseconds delay) override {
+        delay = delay.count() < 0 ? std::chrono::microseconds(0) : delay;
+        std::unique_lock lock(queue_lock);
+        if (!is_active.load(std::memory_order_relaxed)) {
+            return {};
+        }
+        auto id = timer_queue.push(DelayedExecutable(std::move(func), delay), delay);
+        auto deadline = timer_deadline.load(std::memory_order_relaxed);
+        update_timer_deadline();
+        // 工作线程挂起时等待的是更晚的时间，需要唤醒它重新计算
+        if (timer_deadline.load(std::memory_order_relaxed) < deadline && is_sleeping.load()) {
             queue_condition.notify_one();
         }
+        return TimerHandle(this, id);
+    }
+
+    void reap(std::coroutine_handle<> handle) override {
+        reaped_handle = handle;
+    }
+
+    bool cancel(TimerId id) override {
+        std::lock_guard lock(queue_lock);
+        auto cancelled = timer_queue.cancel(id);
+        update_timer_deadline();
+        return cancelled;
     }
 
     void shutdown(bool wait_for_complete = true) {
         is_active.store(false, std::memory_order_relaxed);
+        std::unique_lock lock(queue_lock);
         if (!wait_for_complete) {
             // clear queue.
-            std::unique_lock lock(queue_lock);
-            decltype(executable_queue) empty_queue;
-            std::swap(executable_queue, empty_queue);
-            lock.unlock();
+            executable_queue.drain([](auto&) {});
+            std::coroutine_handle<> handle;
+            while (handle_queue.try_pop(handle)) {}
+            timer_queue.clear();
+            update_timer_deadline();
         }
-
         queue_condition.notify_all();
     }
 };
 
-class SharedLooperExecutor : public AbstractExecutor {
+// 固定数量的工作线程，每个线程一个双端队列，空闲时从其他线程的队列中窃取任务
+class WorkStealingExecutor : public AbstractExecutor {
+private:
+    // 一个待执行的任务：协程句柄或者普通函数
+    struct Executable {
+        std::coroutine_handle<> handle;
+        std::function<void()> func;
+
+        void operator()() {
+            if (handle) {
+                handle.resume();
+            }
+            else {
+                func();
+            }
+        }
+    };
+
+    // 可增长的环形双端队列，容量只增不减，稳定后入队出队都不再分配内存
+    struct ExecutableDeque {
+        std::vector<Executable> ring = std::vector<Executable>(64);
+        size_t head = 0;
+        size_t count = 0;
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        void push_back(Executable&& executable) {
+            if (count == ring.size()) {
+                std::vector<Executable> larger(ring.size() * 2);
+                for (size_t i = 0; i < count; i++) {
+                    larger[i] = std::move(ring[(head + i) & (ring.size() - 1)]);
+                }
+                ring.swap(larger);
+                head = 0;
+            }
+            ring[(head + count) & (ring.size() - 1)] = std::move(executable);
+            count++;
+        }
+
+        Executable pop_back() {
+            count--;
+            return std::move(ring[(head + count) & (ring.size() - 1)]);
+        }
+
+        Executable pop_front() {
+            auto& executable = ring[head];
+            head = (head + 1) & (ring.size() - 1);
+            count--;
+            return std::move(executable);
+        }
+
+        void clear() {
+            while (!empty()) {
+                pop_front();
+            }
+        }
+    };
+
+    struct Worker {
+        std::mutex queue_lock;
+        ExecutableDeque executable_queue;
+        // 等待这个工作线程退出循环后销毁的协程，只由对应的工作线程访问
+        std::coroutine_handle<> reaped_handle;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> work_threads;
+
+    std::atomic<bool> is_active;
+    // 所有队列中尚未被取走的任务总数
+    std::atomic<size_t> pending_count{ 0 };
+    std::atomic<size_t> idle_count{ 0 };
+    std::atomic<size_t> next_worker{ 0 };
+    std::atomic<int> submitting{ 0 };
+
+    std::mutex idle_lock;
+    std::condition_variable idle_condition;
+
+    // 当前工作线程在线程池中的下标
+    static inline thread_local size_t current_index = 0;
+
+    bool pop_local(size_t index, Executable& executable) {
+        auto& worker = *workers[index];
+        std::lock_guard lock(worker.queue_lock);
+        if (worker.executable_queue.empty()) {
+            return false;
+        }
+        // 本地任务按后进先出执行，缓存更热
+        executable = worker.executable_queue.pop_back();
+        pending_count.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(size_t index, Executable& executable) {
+        for (size_t i = 1; i < workers.size(); i++) {
+            auto& victim = *workers[(index + i) % workers.size()];
+            std::unique_lock lock(victim.queue_lock, std::try_to_lock);
+            if (!lock.owns_lock() || victim.executable_queue.empty()) {
+                continue;
+            }
+            // 从队头窃取，和队列所有者在两端操作
+            executable = victim.executable_queue.pop_front();
+            pending_count.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void run_loop(size_t index) {
+        current_executor = this;
+        current_index = index;
+
+        Executable executable;
+        while (true) {
+            if (pop_local(index, executable) || steal(index, executable)) {
+                executable();
+                executable = {};
+                if (workers[index]->reaped_handle) {
+                    break;
+                }
+                continue;
+            }
+
+            std::unique_lock lock(idle_lock);
+            idle_count.fetch_add(1);
+            idle_condition.wait(lock, [this]() {
+                return pending_count.load() > 0 || !is_active.load(std::memory_order_relaxed);
+                });
+            idle_count.fetch_sub(1);
+            if (!is_active.load(std::memory_order_relaxed) && pending_count.load() == 0) {
+                break;
+            }
+        }
+        //debug("run_loop exit.");
+    }
+
+    // 工作线程的入口，销毁协程时调度器随之析构，之后不能再访问任何成员
+    void run(size_t index) {
+        run_loop(index);
+        if (auto handle = std::exchange(workers[index]->reaped_handle, {})) {
+            handle.destroy();
+        }
+    }
+
+    void notify_idle() {
+        if (idle_count.load() > 0) {
+            // 加锁保证等待线程要么还没检查条件，要么已经进入 wait
+            // 在持有锁时通知，析构函数拿到锁之后就不会再有线程访问 idle_condition
+            std::lock_guard lock(idle_lock);
+            idle_condition.notify_one();
+        }
+    }
+
+    void submit(Executable&& executable) {
+        if (!is_active.load(std::memory_order_relaxed)) {
+            return;
+        }
+        SubmitScope scope(submitting, current_executor != this);
+        // 工作线程提交到自己的队列，外部线程轮流分发到各个队列
+        size_t index = current_executor == this
+            ? current_index
+            : next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        auto& worker = *workers[index];
+        {
+            std::lock_guard lock(worker.queue_lock);
+            worker.executable_queue.push_back(std::move(executable));
+        }
+        pending_count.fetch_add(1);
+        notify_idle();
+    }
+
+public:
+
+    explicit WorkStealingExecutor(size_t thread_count = std::thread::hardware_concurrency()) {
+        thread_count = thread_count == 0 ? 1 : thread_count;
+        is_active.store(true, std::memory_order_relaxed);
+        for (size_t i = 0; i < thread_count; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < thread_count; i++) {
+            work_threads.emplace_back(&WorkStealingExecutor::run, this, i);
+        }
+    }
+
+    ~WorkStealingExecutor() {
+        shutdown(false);
+        for (auto& work_thread : work_threads) {
+            // 在工作线程上析构只可能来自 reap，线程随后直接退出
+            if (work_thread.get_id() == std::this_thread::get_id()) {
+                work_thread.detach();
+            }
+            else if (work_thread.joinable()) {
+                work_thread.join();
+            }
+        }
+        SubmitScope::wait_idle(submitting);
+        std::lock_guard lock(idle_lock);
+    }
+
+    void execute(std::function<void()>&& func) override {
+        submit(Executable{ nullptr, std::move(func) });
+    }
+
+    void schedule(std::coroutine_handle<> handle) override {
+        submit(Executable{ handle, nullptr });
+    }
+
+    void reap(std::coroutine_handle<> handle) override {
+        workers[current_index]->reaped_handle = handle;
+    }
+
+    void shutdown(bool wait_for_complete = true) {
+        is_active.store(false, std::memory_order_relaxed);
+        if (!wait_for_complete) {
+            // clear queue.
+            for (auto& worker : workers) {
+                std::lock_guard lock(worker->queue_lock);
+                pending_count.fetch_sub(worker->executable_queue.size());
+                worker->executable_queue.clear();
+            }
+        }
+
+        std::lock_guard lock(idle_lock);
+        idle_condition.notify_all();
+    }
+};
+
+// 每个 CPU 一个 LooperExecutor 分片，可以把分片线程绑定到对应的 CPU 上
+// 协程创建时通过 bind 绑定到一个分片，或者通过 shard_for(key) 指定分片，Channel 和定时器的唤醒都会回到这个分片上执行
+class ShardedExecutor : public AbstractExecutor {
+private:
+    std::vector<std::unique_ptr<LooperExecutor>> shards;
+    std::atomic<size_t> next_shard{ 0 };
+
+    // 当前线程所在的分片，外部线程为 nullptr
+    static inline thread_local ShardedExecutor* current_sharded_executor = nullptr;
+    static inline thread_local size_t current_shard_index = 0;
+
+    // 绑定失败的分片线程数
+    std::atomic<size_t> pin_failures{ 0 };
+
+    // 从当前线程允许运行的 CPU 中按顺序选第 index 个（超出时取模）绑定，失败时返回 false
+    static bool pin_current_thread(size_t index) {
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            return false;
+        }
+        auto count = static_cast<size_t>(CPU_COUNT(&allowed));
+        if (count == 0) {
+            return false;
+        }
+        index %= count;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed) || index-- != 0) {
+                continue;
+            }
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+        }
+        return false;
+#else
+        return false;
+#endif
+    }
+
+    // 在分片内提交的任务留在当前分片，外部线程提交的任务轮流分发
+    LooperExecutor& select_shard() {
+        if (current_sharded_executor == this) {
+            return *shards[current_shard_index];
+        }
+        return *shards[next_shard.fetch_add(1, std::memory_order_relaxed) % shards.size()];
+    }
+
+public:
+
+    explicit ShardedExecutor(size_t shard_count = std::thread::hardware_concurrency(), bool pin_threads = false) {
+        shard_count = shard_count == 0 ? 1 : shard_count;
+        for (size_t i = 0; i < shard_count; i++) {
+            shards.push_back(std::make_unique<LooperExecutor>());
+            // 第一个任务在分片线程上登记分片信息
+            shards[i]->execute([this, i, pin_threads]() {
+                current_sharded_executor = this;
+                current_shard_index = i;
+                if (pin_threads && !pin_current_thread(i)) {
+                    pin_failures.fetch_add(1, std::memory_order_relaxed);
+                }
+                });
+        }
+    }
+
+    size_t size() const {
+        return shards.size();
+    }
+
+    // 开启绑定时未能绑定到 CPU 的分片数，绑定在分片线程上异步完成
+    size_t pin_failure_count() const {
+        return pin_failures.load(std::memory_order_relaxed);
+    }
+
+    LooperExecutor& shard(size_t index) {
+        return *shards[index % shards.size()];
+    }
+
+    // 同一个 key 总是落在同一个分片上
+    template<typename Key>
+    LooperExecutor& shard_for(const Key& key) {
+        return shard(std::hash<Key>{}(key));
+    }
+
+    void execute(std::function<void()>&& func) override {
+        select_shard().execute(std::move(func));
+    }
+
+    void schedule(std::coroutine_handle<> handle) override {
+        select_shard().schedule(handle);
+    }
+
+    TimerHandle execute_after(std::function<void()>&& func, std::chrono::microseconds delay) override {
+        return select_shard().execute_after(std::move(func), delay);
+    }
+
+    // 协程绑定到某一个分片，在分片上创建时留在当前分片，否则轮流分配
+    // 之后 Channel 和定时器的唤醒都经过这个分片，不会跟着唤醒方所在的分片走
+    AbstractExecutor* bind() override {
+        return &select_shard();
+    }
+
+    bool is_in_executor() const override {
+        return current_sharded_executor == this;
+    }
+
+    bool is_worker_thread() const override {
+        return current_sharded_executor == this;
+    }
+
+    // 由当前分片的线程销毁，其他分片在调度器析构时正常 join
+    void reap(std::coroutine_handle<> handle) override {
+        shards[current_shard_index]->reap(handle);
+    }
+
+    void shutdown(bool wait_for_complete = true) {
+        for (auto& shard : shards) {
+            shard->shutdown(wait_for_complete);
+        }
+    }
+};
+
+// 每种调度器类型在进程内只有一个实例，所有使用它的协程共享同一组线程
+template<typename Executor>
+class SharedExecutor : public AbstractExecutor {
 public:
     void execute(std::function<void()>&& func) override {
-        static LooperExecutor sharedLooperExecutor;
-        sharedLooperExecutor.execute(std::move(func));
+        instance().execute(std::move(func));
+    }
+
+    void schedule(std::coroutine_handle<> handle) override {
+        instance().schedule(handle);
+    }
+
+    TimerHandle execute_after(std::function<void()>&& func, std::chrono::microseconds delay) override {
+        return instance().execute_after(std::move(func), delay);
+    }
+
+    AbstractExecutor* bind() override {
+        return instance().bind();
+    }
+
+    bool is_in_executor() const override {
+        return instance().is_in_executor();
+    }
+
+    // 线程属于共享的实例，析构转发对象本身不受影响
+    bool is_worker_thread() const override {
+        return false;
+    }
+
+    static Executor& instance() {
+        static Executor executor;
+        return executor;
     }
 };
+
+using SharedLooperExecutor = SharedExecutor<LooperExecutor>;
+
+using SharedWorkStealingExecutor = SharedExecutor<WorkStealingExecutor>;
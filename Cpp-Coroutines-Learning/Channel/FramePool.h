@@ -0,0 +1,224 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// 协程帧的分配统计，hits 是从空闲链表中直接取到的次数
+struct FramePoolStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    // 在 FrameArena 中分配的次数
+    size_t arena = 0;
+    // 超过最大的大小类别、直接使用全局 operator new 的次数
+    size_t oversize = 0;
+
+    double hit_rate() const {
+        auto total = hits + misses;
+        return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+    }
+};
+
+class FrameArena;
+
+// 协程帧的分配器：按 64 字节划分大小类别，每个线程为每个类别保存一条空闲链表
+// 释放的帧放回释放它的线程的链表，链表满了才交还给全局的 operator delete
+// 每个帧前面有一个头部，记录它是否来自 FrameArena
+class FramePool {
+public:
+    static constexpr size_t granularity = 64;
+    static constexpr size_t class_count = 16;
+    // 每个类别最多缓存的帧数
+    static constexpr size_t max_cached = 256;
+
+    static void* allocate(size_t size);
+
+    static void deallocate(void* frame, size_t size) noexcept;
+
+    // 已经退出的线程的统计加上当前线程的统计
+    static FramePoolStats stats();
+
+private:
+    friend class FrameArena;
+
+    // 保持帧按照 operator new 的默认对齐
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header {
+        FrameArena* arena;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct ThreadCache {
+        FreeBlock* free_lists[class_count] = {};
+        size_t cached[class_count] = {};
+        FramePoolStats stats;
+
+        ~ThreadCache();
+    };
+
+    static inline std::atomic<size_t> total_hits{ 0 };
+    static inline std::atomic<size_t> total_misses{ 0 };
+    static inline std::atomic<size_t> total_arena{ 0 };
+    static inline std::atomic<size_t> total_oversize{ 0 };
+
+    // 线程退出时 ThreadCache 析构之后可能还有帧被释放，这时直接交还给全局的 operator delete
+    static inline thread_local bool cache_destroyed = false;
+
+    static ThreadCache* cache() {
+        if (cache_destroyed) {
+            return nullptr;
+        }
+        static thread_local ThreadCache thread_cache;
+        return &thread_cache;
+    }
+
+    static size_t block_size(size_t size) {
+        return size + sizeof(Header);
+    }
+
+    // 超过最大类别时返回 class_count
+    static size_t size_class(size_t size) {
+        auto index = (block_size(size) + granularity - 1) / granularity - 1;
+        return index < class_count ? index : class_count;
+    }
+
+    static void* frame_of(void* block, FrameArena* arena) {
+        auto header = static_cast<Header*>(block);
+        header->arena = arena;
+        return header + 1;
+    }
+};
+
+// 请求级别的协程帧分配区：Scope 存在期间，当前线程上创建的协程帧从这里顺序分配，释放时什么都不做
+// 所有帧在分配区析构时一起释放，因此其中的 Task 必须先于分配区销毁，不能用于 detach 之后自己结束的协程
+class FrameArena {
+public:
+    explicit FrameArena(size_t chunk_size = 64 * 1024) : chunk_size(chunk_size) {}
+
+    FrameArena(FrameArena&) = delete;
+
+    FrameArena& operator=(FrameArena&) = delete;
+
+    ~FrameArena() {
+        for (auto chunk : chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    // 在当前线程上启用分配区，析构时恢复之前的分配区
+    class Scope {
+    public:
+        explicit Scope(FrameArena& arena) : previous(current) {
+            current = &arena;
+        }
+
+        Scope(Scope&) = delete;
+
+        Scope& operator=(Scope&) = delete;
+
+        ~Scope() {
+            current = previous;
+        }
+
+    private:
+        FrameArena* previous;
+    };
+
+private:
+    friend class FramePool;
+
+    static inline thread_local FrameArena* current = nullptr;
+
+    size_t chunk_size;
+    std::vector<void*> chunks;
+    std::byte* cursor = nullptr;
+    std::byte* end = nullptr;
+
+    void* allocate(size_t size) {
+        constexpr size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+        size = (size + alignment - 1) & ~(alignment - 1);
+        if (static_cast<size_t>(end - cursor) < size) {
+            auto capacity = size > chunk_size ? size : chunk_size;
+            auto chunk = ::operator new(capacity);
+            chunks.push_back(chunk);
+            cursor = static_cast<std::byte*>(chunk);
+            end = cursor + capacity;
+        }
+        auto block = cursor;
+        cursor += size;
+        return block;
+    }
+};
+
+inline FramePool::ThreadCache::~ThreadCache() {
+    for (size_t i = 0; i < class_count; i++) {
+        while (auto block = free_lists[i]) {
+            free_lists[i] = block->next;
+            ::operator delete(block);
+        }
+    }
+    total_hits.fetch_add(stats.hits, std::memory_order_relaxed);
+    total_misses.fetch_add(stats.misses, std::memory_order_relaxed);
+    total_arena.fetch_add(stats.arena, std::memory_order_relaxed);
+    total_oversize.fetch_add(stats.oversize, std::memory_order_relaxed);
+    cache_destroyed = true;
+}
+
+inline void* FramePool::allocate(size_t size) {
+    auto cache = FramePool::cache();
+    if (auto arena = FrameArena::current) {
+        if (cache) {
+            cache->stats.arena++;
+        }
+        return frame_of(arena->allocate(block_size(size)), arena);
+    }
+    auto index = size_class(size);
+    if (index == class_count || !cache) {
+        if (cache) {
+            cache->stats.oversize++;
+        }
+        return frame_of(::operator new(block_size(size)), nullptr);
+    }
+    if (auto block = cache->free_lists[index]) {
+        cache->free_lists[index] = block->next;
+        cache->cached[index]--;
+        cache->stats.hits++;
+        return frame_of(block, nullptr);
+    }
+    cache->stats.misses++;
+    return frame_of(::operator new((index + 1) * granularity), nullptr);
+}
+
+inline void FramePool::deallocate(void* frame, size_t size) noexcept {
+    auto header = static_cast<Header*>(frame) - 1;
+    if (header->arena) {
+        return;
+    }
+    auto index = size_class(size);
+    auto cache = FramePool::cache();
+    if (index == class_count || !cache || cache->cached[index] >= max_cached) {
+        ::operator delete(header);
+        return;
+    }
+    auto block = reinterpret_cast<FreeBlock*>(header);
+    block->next = cache->free_lists[index];
+    cache->free_lists[index] = block;
+    cache->cached[index]++;
+}
+
+inline FramePoolStats FramePool::stats() {
+    FramePoolStats result;
+    result.hits = total_hits.load(std::memory_order_relaxed);
+    result.misses = total_misses.load(std::memory_order_relaxed);
+    result.arena = total_arena.load(std::memory_order_relaxed);
+    result.oversize = total_oversize.load(std::memory_order_relaxed);
+    if (auto cache = FramePool::cache()) {
+        result.hits += cache->stats.hits;
+        result.misses += cache->stats.misses;
+        result.arena += cache->stats.arena;
+        result.oversize += cache->stats.oversize;
+    }
+    return result;
+}
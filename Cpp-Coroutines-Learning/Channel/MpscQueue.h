@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+// 多生产者单消费者的无锁队列
+// 生产者用 CAS 把节点压入链表头部，消费者一次性取走整条链表并反转为 FIFO 顺序
+template<typename T>
+class MpscQueue {
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> head{ nullptr };
+
+public:
+
+    MpscQueue() = default;
+
+    MpscQueue(MpscQueue&) = delete;
+
+    MpscQueue& operator=(MpscQueue&) = delete;
+
+    ~MpscQueue() {
+        drain([](T&) {});
+    }
+
+    // 返回 push 之前队列是否为空，消费者只可能在队列为空时挂起
+    bool push(T&& value) {
+        auto node = new Node{ std::move(value), nullptr };
+        auto old_head = head.load(std::memory_order_relaxed);
+        do {
+            node->next = old_head;
+        } while (!head.compare_exchange_weak(old_head, node, std::memory_order_seq_cst, std::memory_order_relaxed));
+        return old_head == nullptr;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+    // 取走当前所有元素并按入队顺序依次处理，返回处理的个数
+    template<typename Func>
+    size_t drain(Func&& func) {
+        auto node = head.exchange(nullptr, std::memory_order_acquire);
+        Node* fifo = nullptr;
+        while (node) {
+            auto next = node->next;
+            node->next = fifo;
+            fifo = node;
+            node = next;
+        }
+
+        size_t count = 0;
+        while (fifo) {
+            auto next = fifo->next;
+            func(fifo->value);
+            delete fifo;
+            fifo = next;
+            count++;
+        }
+        return count;
+    }
+};
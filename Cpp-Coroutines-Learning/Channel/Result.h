@@ -1,24 +1,34 @@
 #pragma once
 #include <exception>
+#include <optional>
+#include <utility>
 
+// 值保存在 std::optional 中，T 不需要默认构造，只能移动的 T 也可以使用
 template<typename T>
 struct Result {
 
-    explicit Result() = default;
-
-    explicit Result(T&& value) : _value(value) {}
+    explicit Result(T&& value) : _value(std::move(value)) {}
 
     explicit Result(std::exception_ptr&& exception_ptr) : _exception_ptr(exception_ptr) {}
 
-    T get_or_throw() {
+    // 可能有多个回调读取同一个结果，不复制值
+    const T& get_or_throw() const & {
+        if (_exception_ptr) {
+            std::rethrow_exception(_exception_ptr);
+        }
+        return *_value;
+    }
+
+    // 唯一的读取者把值移动出来
+    T get_or_throw() && {
         if (_exception_ptr) {
             std::rethrow_exception(_exception_ptr);
         }
-        return _value;
+        return std::move(*_value);
     }
 
 private:
-    T _value{};
+    std::optional<T> _value;
     std::exception_ptr _exception_ptr;
 };
 
@@ -29,7 +39,7 @@ struct Result<void> {
 
     explicit Result(std::exception_ptr&& exception_ptr) : _exception_ptr(exception_ptr) {}
 
-    void get_or_throw() {
+    void get_or_throw() const {
         if (_exception_ptr) {
             std::rethrow_exception(_exception_ptr);
         }
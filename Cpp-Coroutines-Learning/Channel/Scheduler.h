@@ -2,41 +2,92 @@
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
 #include <functional>
 #include <chrono>
+#include <limits>
+#include <utility>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 #include "io_utils.h"
 
-class DelayedExecutable {
+using TimerId = unsigned long long;
+
+// 定时器统一使用 steady_clock 的微秒数，不受系统时间调整的影响
+inline long long current_time_micros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// 能够取消定时器的对象
+class TimerCanceller {
 public:
-    DelayedExecutable(std::function<void()>&& func, long long delay) : func(std::move(func)) {
-        using namespace std;
-        using namespace std::chrono;
-        auto now = system_clock::now();
-        auto current = duration_cast<milliseconds>(now.time_since_epoch()).count();
+    // 定时器已经执行或者已经取消时返回 false
+    virtual bool cancel(TimerId id) = 0;
+};
+
+// 定时器的取消句柄，只能取消一次
+class TimerHandle {
+public:
+    TimerHandle() = default;
+
+    TimerHandle(TimerCanceller* canceller, TimerId id) : canceller(canceller), id(id) {}
+
+    bool cancel() {
+        auto canceller = std::exchange(this->canceller, nullptr);
+        return canceller && canceller->cancel(id);
+    }
 
-        scheduled_time = current + delay;
+    // 定时器已经执行后调用，之后不再需要取消
+    void reset() {
+        canceller = nullptr;
     }
 
-    long long delay() const {
-        using namespace std;
-        using namespace std::chrono;
+    explicit operator bool() const {
+        return canceller != nullptr;
+    }
 
-        auto now = system_clock::now();
-        auto current = duration_cast<milliseconds>(now.time_since_epoch()).count();
-        return scheduled_time - current;
+private:
+    TimerCanceller* canceller = nullptr;
+    TimerId id = 0;
+};
+
+class DelayedExecutable {
+public:
+    DelayedExecutable(std::function<void()>&& func, std::chrono::microseconds delay) : func(std::move(func)) {
+        scheduled_time = current_time_micros() + delay.count();
+    }
+
+    std::chrono::microseconds delay() const {
+        return std::chrono::microseconds(scheduled_time - current_time_micros());
     }
 
     long long get_scheduled_time() const {
         return scheduled_time;
     }
 
+    TimerId get_id() const {
+        return id;
+    }
+
+    void set_id(TimerId id) {
+        this->id = id;
+    }
+
     void operator()() {
         func();
     }
 
 private:
     long long scheduled_time;
+    TimerId id = 0;
     std::function<void()> func;
 };
 
@@ -47,42 +98,165 @@ public:
     }
 };
 
-class Scheduler {
+// 二叉堆实现的定时器队列，插入 O(log n)，取消只做标记，出队时再跳过
+// 被取消的元素超过一半时整体重建，保证堆的大小不超过有效定时器数量的两倍
+class HeapTimerQueue {
+private:
+    std::vector<DelayedExecutable> heap;
+    // 还没有执行也没有被取消的定时器，不在其中的堆元素出队时直接丢弃
+    std::unordered_set<TimerId> pending;
+    TimerId next_id = 1;
+
+public:
+
+    TimerId push(DelayedExecutable&& executable) {
+        auto id = next_id++;
+        executable.set_id(id);
+        pending.insert(id);
+        heap.push_back(std::move(executable));
+        std::push_heap(heap.begin(), heap.end(), DelayedExecutableCompare());
+        return id;
+    }
+
+    bool cancel(TimerId id) {
+        if (pending.erase(id) == 0) {
+            return false;
+        }
+        if (heap.size() > 64 && pending.size() < heap.size() / 2) {
+            std::erase_if(heap, [this](DelayedExecutable& executable) {
+                return !pending.contains(executable.get_id());
+                });
+            std::make_heap(heap.begin(), heap.end(), DelayedExecutableCompare());
+        }
+        return true;
+    }
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+    long long next_time() const {
+        return heap.front().get_scheduled_time();
+    }
+
+    // 把所有已经到期的定时器一次性取出
+    void pop_expired(long long now, std::vector<DelayedExecutable>& expired) {
+        while (!heap.empty() && heap.front().get_scheduled_time() <= now) {
+            std::pop_heap(heap.begin(), heap.end(), DelayedExecutableCompare());
+            if (pending.erase(heap.back().get_id()) > 0) {
+                expired.push_back(std::move(heap.back()));
+            }
+            heap.pop_back();
+        }
+    }
+
+    void clear() {
+        heap.clear();
+        pending.clear();
+    }
+};
+
+template<typename TimerQueue = HeapTimerQueue>
+class Scheduler : public TimerCanceller {
 private:
     std::condition_variable queue_condition;
     std::mutex queue_lock;
-    std::priority_queue<DelayedExecutable, std::vector<DelayedExecutable>, DelayedExecutableCompare> executable_queue;
+    TimerQueue executable_queue;
+    // 工作线程下一次醒来的时间，新加入的定时器比它更早时才需要通知
+    long long wakeup_time = std::numeric_limits<long long>::max();
+    std::vector<DelayedExecutable> expired;
 
     std::atomic<bool> is_active;
     std::thread work_thread;
 
+    // 高精度模式下用 timerfd 等待到期时间，用 eventfd 接收新定时器的通知
+    // condition_variable 的超时会被内核合并到 timer slack 中，延迟通常有几十微秒
+    bool high_resolution = false;
+    int timer_fd = -1;
+    int event_fd = -1;
+
+    void wait(std::unique_lock<std::mutex>& lock, long long now) {
+#ifdef __linux__
+        if (high_resolution) {
+            itimerspec spec{};
+            if (wakeup_time != std::numeric_limits<long long>::max()) {
+                // steady_clock 就是 CLOCK_MONOTONIC，这里设置绝对时间
+                spec.it_value.tv_sec = wakeup_time / 1000000;
+                spec.it_value.tv_nsec = wakeup_time % 1000000 * 1000;
+            }
+            timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+            lock.unlock();
+
+            pollfd fds[2] = { { timer_fd, POLLIN, 0 }, { event_fd, POLLIN, 0 } };
+            poll(fds, 2, -1);
+            unsigned long long count;
+            if (fds[0].revents & POLLIN) {
+                read(timer_fd, &count, sizeof(count));
+            }
+            if (fds[1].revents & POLLIN) {
+                read(event_fd, &count, sizeof(count));
+            }
+            return;
+        }
+#endif
+        if (wakeup_time == std::numeric_limits<long long>::max()) {
+            queue_condition.wait(lock);
+        }
+        else {
+            queue_condition.wait_for(lock, std::chrono::microseconds(wakeup_time - now));
+        }
+    }
+
+    void notify() {
+#ifdef __linux__
+        if (high_resolution) {
+            unsigned long long count = 1;
+            write(event_fd, &count, sizeof(count));
+            return;
+        }
+#endif
+        queue_condition.notify_all();
+    }
+
     void run_loop() {
-        while (is_active.load(std::memory_order_relaxed) || !executable_queue.empty()) {
+        while (true) {
             std::unique_lock lock(queue_lock);
+            auto now = current_time_micros();
             if (executable_queue.empty()) {
-                queue_condition.wait(lock);
-                if (executable_queue.empty()) {
-                    continue;
+                if (!is_active.load(std::memory_order_relaxed)) {
+                    break;
                 }
+                wakeup_time = std::numeric_limits<long long>::max();
+                wait(lock, now);
+                continue;
             }
-            auto executable = executable_queue.top();
-            long long delay = executable.delay();
-            if (delay > 0) {
-                auto status = queue_condition.wait_for(lock, std::chrono::milliseconds(delay));
-                if (status != std::cv_status::timeout) {
-                    // a new executable should be executed before.
-                    continue;
-                }
+            wakeup_time = executable_queue.next_time();
+            if (wakeup_time > now) {
+                // 超时或者有更早的定时器加入，都重新计算
+                wait(lock, now);
+                continue;
             }
-            executable_queue.pop();
+
+            // 一次取出所有到期的定时器，释放锁之后再执行
+            executable_queue.pop_expired(now, expired);
             lock.unlock();
-            executable();
+            for (auto& executable : expired) {
+                executable();
+            }
+            expired.clear();
         }
         debug("run_loop exit.");
     }
 public:
 
-    Scheduler() {
+    explicit Scheduler(bool high_resolution = false) {
+#ifdef __linux__
+        if (high_resolution) {
+            timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+            event_fd = eventfd(0, EFD_CLOEXEC);
+            this->high_resolution = timer_fd >= 0 && event_fd >= 0;
+        }
+#endif
         is_active.store(true, std::memory_order_relaxed);
         work_thread = std::thread(&Scheduler::run_loop, this);
     }
@@ -90,32 +264,49 @@ public:
     ~Scheduler() {
         shutdown(false);
         join();
+#ifdef __linux__
+        if (timer_fd >= 0) {
+            close(timer_fd);
+        }
+        if (event_fd >= 0) {
+            close(event_fd);
+        }
+#endif
     }
 
-    void execute(std::function<void()>&& func, long long delay) {
-        delay = delay < 0 ? 0 : delay;
+    // 返回的句柄可以用来取消还没有执行的定时器
+    TimerHandle execute(std::function<void()>&& func, std::chrono::microseconds delay) {
+        delay = delay.count() < 0 ? std::chrono::microseconds(0) : delay;
         std::unique_lock lock(queue_lock);
         if (is_active.load(std::memory_order_relaxed)) {
-            bool need_notify = executable_queue.empty() || executable_queue.top().delay() > delay;
-            executable_queue.push(DelayedExecutable(std::move(func), delay));
+            DelayedExecutable executable(std::move(func), delay);
+            bool need_notify = executable.get_scheduled_time() < wakeup_time;
+            auto id = executable_queue.push(std::move(executable));
             lock.unlock();
             if (need_notify) {
-                queue_condition.notify_one();
+                notify();
             }
+            return TimerHandle(this, id);
         }
+        return {};
+    }
+
+    bool cancel(TimerId id) override {
+        std::lock_guard lock(queue_lock);
+        return executable_queue.cancel(id);
     }
 
     void shutdown(bool wait_for_complete = true) {
         is_active.store(false, std::memory_order_relaxed);
+        // 加锁保证工作线程不会在检查 is_active 之后、开始等待之前错过通知
+        std::unique_lock lock(queue_lock);
         if (!wait_for_complete) {
             // clear queue.
-            std::unique_lock lock(queue_lock);
-            decltype(executable_queue) empty_queue;
-            std::swap(executable_queue, empty_queue);
-            lock.unlock();
+            executable_queue.clear();
         }
+        lock.unlock();
 
-        queue_condition.notify_all();
+        notify();
     }
 
     void join() {
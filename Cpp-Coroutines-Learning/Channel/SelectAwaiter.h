@@ -0,0 +1,223 @@
+#pragma once
+#include <coroutine>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <optional>
+#include <utility>
+#include "Executor.h"
+#include "Channel.h"
+
+// select 的超时分支
+struct SelectTimeout {
+    std::chrono::microseconds duration;
+    TimerHandle timer{};
+};
+
+template<typename _Rep, typename _Period>
+SelectTimeout timeout(std::chrono::duration<_Rep, _Period> duration) {
+    return SelectTimeout{ std::chrono::ceil<std::chrono::microseconds>(duration) };
+}
+
+// 每个分支完成时的结果：读取分支是读到的值，写入和超时分支没有值
+template<typename Arm>
+struct SelectResult {
+    using type = std::monostate;
+};
+
+template<typename ValueType, typename Policy>
+struct SelectResult<ReaderAwaiter<ValueType, Policy>> {
+    using type = ValueType;
+};
+
+// 同时等待多个 Channel 的读写和超时，只有最先完成的一个分支生效，返回的 variant 的下标就是这个分支的位置
+// 分支只能是 Channel::read()、Channel::write() 和 timeout()
+// 先不加锁地依次尝试每个分支；都不能完成时把所有分支登记到各自的等待列表中，由 SelectState 保证只有一个分支被认领，
+// 其余分支在恢复之后撤出。分支所在的 Channel 关闭时这个分支获胜，并像普通的读写一样抛出异常
+template<typename... Arms>
+struct SelectAwaiter {
+    using ResultType = std::variant<typename SelectResult<Arms>::type...>;
+
+    std::tuple<Arms...> arms;
+    AbstractExecutor* executor = nullptr;
+
+    explicit SelectAwaiter(Arms&&... arms) : arms(std::move(arms)...) {}
+
+    SelectAwaiter(SelectAwaiter&& other) noexcept
+        : arms(std::move(other.arms)), executor(other.executor), ready_index(other.ready_index) {}
+
+    SelectAwaiter(SelectAwaiter&) = delete;
+
+    SelectAwaiter& operator=(SelectAwaiter&) = delete;
+
+    // 协程在等待期间被销毁时取消定时器，Channel 中的分支由各自的析构函数撤出
+    ~SelectAwaiter() {
+        cancel_timers(std::index_sequence_for<Arms...>());
+    }
+
+    bool await_ready() {
+        return try_arms(std::index_sequence_for<Arms...>());
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state = std::make_shared<SelectState>();
+        state->handle = handle;
+        state->executor = executor;
+        if (register_arms(std::index_sequence_for<Arms...>())) {
+            return false;
+        }
+        start_timers(std::index_sequence_for<Arms...>());
+        // 分支可能在登记期间就已经完成，这时由当前线程直接继续
+        return !state->arrive();
+    }
+
+    ResultType await_resume() {
+        auto index = state ? state->winner.load(std::memory_order_acquire) : ready_index;
+        withdraw_arms(index, std::index_sequence_for<Arms...>());
+        std::optional<ResultType> result;
+        take_result(index, result, std::index_sequence_for<Arms...>());
+        return std::move(*result);
+    }
+
+private:
+    std::shared_ptr<SelectState> state;
+    // 不挂起就完成的分支
+    int ready_index = 0;
+
+    template<size_t... I>
+    bool try_arms(std::index_sequence<I...>) {
+        return (try_arm<I>(std::get<I>(arms)) || ...);
+    }
+
+    template<size_t I, typename ValueType, typename Policy>
+    bool try_arm(ReaderAwaiter<ValueType, Policy>& arm) {
+        if (auto value = arm.channel->fast_read()) {
+            arm.set_value(std::move(*value));
+            ready_index = I;
+            return true;
+        }
+        return false;
+    }
+
+    template<size_t I, typename ValueType, typename Policy>
+    bool try_arm(WriterAwaiter<ValueType, Policy>& arm) {
+        if (arm.channel->fast_write(arm._value)) {
+            ready_index = I;
+            return true;
+        }
+        return false;
+    }
+
+    template<size_t I>
+    bool try_arm(SelectTimeout&) {
+        return false;
+    }
+
+    // 有分支在登记时立即完成时返回 true
+    template<size_t... I>
+    bool register_arms(std::index_sequence<I...>) {
+        return (register_arm<I>(std::get<I>(arms)) || ...);
+    }
+
+    template<size_t I, typename ValueType, typename Policy>
+    bool register_arm(ReaderAwaiter<ValueType, Policy>& arm) {
+        arm.select = state.get();
+        arm.select_index = I;
+        return arm.channel->select_reader(&arm);
+    }
+
+    template<size_t I, typename ValueType, typename Policy>
+    bool register_arm(WriterAwaiter<ValueType, Policy>& arm) {
+        arm.select = state.get();
+        arm.select_index = I;
+        return arm.channel->select_writer(&arm);
+    }
+
+    template<size_t I>
+    bool register_arm(SelectTimeout&) {
+        return false;
+    }
+
+    template<size_t... I>
+    void start_timers(std::index_sequence<I...>) {
+        (start_timer<I>(std::get<I>(arms)), ...);
+    }
+
+    template<size_t I, typename Arm>
+    void start_timer(Arm&) {}
+
+    template<size_t I>
+    void start_timer(SelectTimeout& arm) {
+        // 定时器回调只持有共享的状态，协程结束之后执行也是安全的
+        arm.timer = executor->execute_after([state = state]() {
+            if (state->acquire()) {
+                state->commit(I);
+                state->wake();
+            }
+            }, arm.duration);
+    }
+
+    template<size_t... I>
+    void cancel_timers(std::index_sequence<I...>) {
+        (cancel_timer(std::get<I>(arms)), ...);
+    }
+
+    template<typename Arm>
+    void cancel_timer(Arm&) {}
+
+    void cancel_timer(SelectTimeout& arm) {
+        arm.timer.cancel();
+    }
+
+    // 其他分支已经作废，只需要从等待列表中移出
+    template<size_t... I>
+    void withdraw_arms(int index, std::index_sequence<I...>) {
+        (withdraw_arm(index == static_cast<int>(I), std::get<I>(arms)), ...);
+    }
+
+    template<typename ValueType, typename Policy>
+    void withdraw_arm(bool won, ReaderAwaiter<ValueType, Policy>& arm) {
+        if (!won && arm.channel) {
+            arm.channel->remove_reader(&arm);
+            arm.channel = nullptr;
+        }
+    }
+
+    template<typename ValueType, typename Policy>
+    void withdraw_arm(bool won, WriterAwaiter<ValueType, Policy>& arm) {
+        if (!won && arm.channel) {
+            arm.channel->remove_writer(&arm);
+            arm.channel = nullptr;
+        }
+    }
+
+    void withdraw_arm(bool, SelectTimeout& arm) {
+        arm.timer.cancel();
+    }
+
+    template<size_t... I>
+    void take_result(int index, std::optional<ResultType>& result, std::index_sequence<I...>) {
+        ((index == static_cast<int>(I) ? take_arm<I>(result, std::get<I>(arms)) : void()), ...);
+    }
+
+    template<size_t I, typename ValueType, typename Policy>
+    void take_arm(std::optional<ResultType>& result, ReaderAwaiter<ValueType, Policy>& arm) {
+        result.emplace(std::in_place_index<I>, arm.await_resume());
+    }
+
+    template<size_t I, typename ValueType, typename Policy>
+    void take_arm(std::optional<ResultType>& result, WriterAwaiter<ValueType, Policy>& arm) {
+        arm.await_resume();
+        result.emplace(std::in_place_index<I>);
+    }
+
+    template<size_t I>
+    void take_arm(std::optional<ResultType>& result, SelectTimeout&) {
+        result.emplace(std::in_place_index<I>);
+    }
+};
+
+template<typename... Arms>
+auto select(Arms&&... arms) {
+    return SelectAwaiter<std::decay_t<Arms>...>(std::move(arms)...);
+}
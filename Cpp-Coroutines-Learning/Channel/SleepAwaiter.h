@@ -1,28 +1,72 @@
 #pragma once
 #include "Executor.h"
-#include "Scheduler.h"
 #include <coroutine>
+#include <memory>
+#include <mutex>
 
 struct SleepAwaiter {
 
-    explicit SleepAwaiter(AbstractExecutor* executor, long long duration) noexcept
+    explicit SleepAwaiter(AbstractExecutor* executor, std::chrono::microseconds duration) noexcept
         : _executor(executor), _duration(duration) {}
 
-    bool await_ready() const { return false; }
+    SleepAwaiter(SleepAwaiter&) = delete;
+
+    SleepAwaiter& operator=(SleepAwaiter&) = delete;
 
-    void await_suspend(std::coroutine_handle<> handle) const {
-        static Scheduler scheduler;
+    // 协程在等待期间被销毁时取消定时器，已经开始执行的回调看到 finished 之后不会再恢复协程
+    ~SleepAwaiter() {
+        if (state) {
+            std::lock_guard lock(state->lock);
+            state->finished = true;
+            timer.cancel();
+        }
+    }
+
+    bool await_ready() const { return false; }
 
-        scheduler.execute([this, handle]() {
-            _executor->execute([handle]() {
-                handle.resume();
-                });
+    bool await_suspend(std::coroutine_handle<> handle) {
+        auto state = std::make_shared<SleepState>();
+        this->state = state;
+        // 定时器在持有锁时设置，回调一定在 timer 保存之后才会检查状态
+        std::lock_guard lock(state->lock);
+        // 定时器到期时已经在调度器的线程上，直接恢复协程
+        timer = _executor->execute_after([state, handle]() {
+            std::unique_lock lock(state->lock);
+            if (state->finished) {
+                return;
+            }
+            state->finished = true;
+            lock.unlock();
+            handle.resume();
             }, _duration);
+        return true;
     }
 
-    void await_resume() {}
+    void await_resume() {
+        timer.reset();
+    }
+
+    // 还没有到期时撤出等待，返回 true 之后不会再恢复协程
+    bool cancel() {
+        std::lock_guard lock(state->lock);
+        if (state->finished) {
+            return false;
+        }
+        state->finished = true;
+        timer.cancel();
+        return true;
+    }
 
 private:
+    // 定时器回调和等待的协程共享，回调不访问 awaiter
+    struct SleepState {
+        std::mutex lock;
+        // 协程已经恢复或者放弃等待
+        bool finished = false;
+    };
+
     AbstractExecutor* _executor;
-    long long _duration;
-};
\ No newline at end of file
+    std::chrono::microseconds _duration;
+    TimerHandle timer;
+    std::shared_ptr<SleepState> state;
+};
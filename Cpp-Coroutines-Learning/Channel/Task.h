@@ -11,7 +11,7 @@ struct Task {
     }
 
     Task& then(std::function<void(ResultType)>&& func) {
-        handle.promise().on_completed([func](auto result) {
+        handle.promise().on_completed([func](auto& result) {
             try {
                 func(result.get_or_throw());
             }
@@ -23,7 +23,7 @@ struct Task {
     }
 
     Task& catching(std::function<void(std::exception&)>&& func) {
-        handle.promise().on_completed([func](auto result) {
+        handle.promise().on_completed([func](auto& result) {
             try {
                 result.get_or_throw();
             }
@@ -35,7 +35,7 @@ struct Task {
     }
 
     Task& finally(std::function<void()>&& func) {
-        handle.promise().on_completed([func](auto result) { func(); });
+        handle.promise().on_completed([func](auto& result) { func(); });
         return *this;
     }
 
@@ -52,6 +52,20 @@ struct Task {
     }
 
 private:
+    template<typename, typename>
+    friend struct TaskAwaiter;
+
+    template<typename...>
+    friend struct WhenAllAwaiter;
+
+    template<typename, typename>
+    friend struct WhenAllRangeAwaiter;
+
+    template<typename...>
+    friend struct WhenAnyAwaiter;
+
+    friend struct WhenAllState;
+
     std::coroutine_handle<promise_type> handle;
 };
 
@@ -65,7 +79,7 @@ struct Task<void, Executor> {
     }
 
     Task& then(std::function<void()>&& func) {
-        handle.promise().on_completed([func](auto result) {
+        handle.promise().on_completed([func](auto& result) {
             try {
                 result.get_or_throw();
                 func();
@@ -78,7 +92,7 @@ struct Task<void, Executor> {
     }
 
     Task& catching(std::function<void(std::exception&)>&& func) {
-        handle.promise().on_completed([func](auto result) {
+        handle.promise().on_completed([func](auto& result) {
             try {
                 result.get_or_throw();
             }
@@ -90,7 +104,7 @@ struct Task<void, Executor> {
     }
 
     Task& finally(std::function<void()>&& func) {
-        handle.promise().on_completed([func](auto result) { func(); });
+        handle.promise().on_completed([func](auto& result) { func(); });
         return *this;
     }
 
@@ -107,5 +121,19 @@ struct Task<void, Executor> {
     }
 
 private:
+    template<typename, typename>
+    friend struct TaskAwaiter;
+
+    template<typename...>
+    friend struct WhenAllAwaiter;
+
+    template<typename, typename>
+    friend struct WhenAllRangeAwaiter;
+
+    template<typename...>
+    friend struct WhenAnyAwaiter;
+
+    friend struct WhenAllState;
+
     std::coroutine_handle<promise_type> handle;
 };
\ No newline at end of file
@@ -16,20 +16,31 @@ struct TaskAwaiter {
 
     TaskAwaiter& operator=(TaskAwaiter&) = delete;
 
-    constexpr bool await_ready() const noexcept {
-        return false;
+    bool await_ready() noexcept {
+        return task.handle.promise().is_completed();
     }
 
-    void await_suspend(std::coroutine_handle<> handle) noexcept {
-        task.finally([handle, this]() {
-            _executor->execute([handle]() {
-                handle.resume();
-                });
-            });
+    // 子任务结束时由它的 FinalAwaiter 切换回当前协程
+    // 只有在 await_ready 之后子任务恰好完成时才直接返回当前协程
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept {
+        if (task.handle.promise().set_continuation(handle, _executor)) {
+            return std::noop_coroutine();
+        }
+        return handle;
     }
 
-    Result await_resume() noexcept {
-        return task.get_result();
+    // 子任务只有当前协程在等待，结果直接移动过来
+    Result await_resume() {
+        return task.handle.promise().take_result();
+    }
+
+    // 超时后不再等待子任务，子任务继续执行，结束时自己销毁
+    bool cancel() {
+        if (!task.handle.promise().detach()) {
+            return false;
+        }
+        task.handle = nullptr;
+        return true;
     }
 
 private:
@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include "Executor.h"
+#include "Result.h"
+
+// 任务完成时调用的函数，由 when_all、when_any 这样的组合使用
+using CompletionHook = void (*)(void* context);
+
+// TaskPromise 的完成状态：一个原子变量记录等待中、已有等待的协程、已有完成函数、已放弃和已完成五种状态
+// co_await 子任务和组合登记完成函数都只需要一次 CAS，不加锁也不分配内存
+// then、catching、finally 的回调和阻塞的 get_result 走加锁的慢速路径，出现时在状态上加 slow 标记，完成的一方看到标记才去加锁
+template<typename ResultType>
+class TaskCompletion {
+public:
+    TaskCompletion() = default;
+
+    TaskCompletion(TaskCompletion&) = delete;
+
+    TaskCompletion& operator=(TaskCompletion&) = delete;
+
+    // 只由协程自己在完成之前调用，complete 中的原子操作把结果发布给其他线程
+    void set_result(Result<ResultType>&& value) {
+        result.emplace(std::move(value));
+    }
+
+    // 已经完成时，如果完成的一方还在慢速路径上，等它离开临界区之后再返回，调用者随后可以安全地销毁协程
+    bool is_completed() {
+        auto current = state.load(std::memory_order_acquire);
+        if (kind(current) != completed) {
+            return false;
+        }
+        if (current & slow) {
+            std::lock_guard lock(completion_lock);
+        }
+        return true;
+    }
+
+    // 阻塞到完成为止，唯一的等待者可以把结果移动出去
+    Result<ResultType>& wait() {
+        if (!is_completed()) {
+            std::unique_lock lock(completion_lock);
+            if (mark_slow()) {
+                completion.wait(lock, [this]() {
+                    return kind(state.load(std::memory_order_acquire)) == completed;
+                    });
+            }
+        }
+        return *result;
+    }
+
+    // 记录等待当前任务的协程，任务已经完成时返回 false
+    bool set_continuation(std::coroutine_handle<> handle, AbstractExecutor* handle_executor) {
+        continuation = handle;
+        continuation_executor = handle_executor;
+        auto current = state.load(std::memory_order_relaxed);
+        while (kind(current) == pending) {
+            if (state.compare_exchange_weak(current, awaiting | (current & slow),
+                std::memory_order_release, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 记录完成时在完成的线程上调用的 hook，和 set_continuation 只能二选一，并且只能设置一次
+    // 任务已经完成时返回 false，不会再调用 hook，返回之前等完成的一方离开临界区，调用者随后可以安全地销毁协程
+    bool set_hook(CompletionHook hook, void* context) {
+        completion_hook = hook;
+        hook_context = context;
+        auto current = state.load(std::memory_order_relaxed);
+        while (kind(current) == pending) {
+            if (state.compare_exchange_weak(current, hooked | (current & slow),
+                std::memory_order_release, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        is_completed();
+        return false;
+    }
+
+    // 放弃等待还没有结束的协程，协程结束时自己销毁，已经结束时返回 false
+    bool detach() {
+        auto current = state.load(std::memory_order_relaxed);
+        while (kind(current) != completed) {
+            if (state.compare_exchange_weak(current, detached | (current & slow),
+                std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void on_completed(std::function<void(const Result<ResultType>&)>&& func) {
+        std::unique_lock lock(completion_lock);
+        if (mark_slow()) {
+            completion_callbacks.push_back(std::move(func));
+            return;
+        }
+        lock.unlock();
+        func(*result);
+    }
+
+    // 协程已经挂起在终止点，通知所有等待者并返回接下来要执行的协程
+    // 任务已经被放弃时 is_detached 为 true，由调用者销毁协程
+    // 状态切换为已完成之后当前对象随时可能被销毁，之后只能使用局部变量
+    std::coroutine_handle<> complete(bool& is_detached) noexcept {
+        auto current = state.load(std::memory_order_acquire);
+        while (!(current & slow)) {
+            // hook 的所有者可能在状态切换之后立刻销毁协程，先把 hook 读出来
+            auto hook = kind(current) == hooked ? completion_hook : nullptr;
+            auto context = hook ? hook_context : nullptr;
+            if (state.compare_exchange_weak(current, completed,
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+                is_detached = kind(current) == detached;
+                if (hook) {
+                    hook(context);
+                    return std::noop_coroutine();
+                }
+                if (kind(current) != awaiting) {
+                    return std::noop_coroutine();
+                }
+                // 等待的协程持有 Task，在恢复它之前当前对象一定还在
+                return resume(continuation, continuation_executor);
+            }
+        }
+
+        std::unique_lock lock(completion_lock);
+        // 回调在锁外执行，执行期间新注册的回调在下一轮取出
+        while (!completion_callbacks.empty()) {
+            auto callbacks = std::move(completion_callbacks);
+            completion_callbacks.clear();
+            lock.unlock();
+            for (auto& callback : callbacks) {
+                callback(*result);
+            }
+            lock.lock();
+        }
+        // 保留 slow 标记，is_completed 据此等待当前线程释放锁
+        current = state.exchange(completed | slow, std::memory_order_acq_rel);
+        is_detached = kind(current) == detached;
+        auto handle = kind(current) == awaiting ? continuation : nullptr;
+        auto handle_executor = continuation_executor;
+        auto hook = kind(current) == hooked ? completion_hook : nullptr;
+        auto context = hook ? hook_context : nullptr;
+        completion.notify_all();
+        lock.unlock();
+
+        if (hook) {
+            hook(context);
+            return std::noop_coroutine();
+        }
+        if (!handle) {
+            return std::noop_coroutine();
+        }
+        return resume(handle, handle_executor);
+    }
+
+private:
+    static constexpr unsigned pending = 0;
+    static constexpr unsigned awaiting = 1;
+    static constexpr unsigned detached = 2;
+    static constexpr unsigned completed = 3;
+    static constexpr unsigned hooked = 4;
+    static constexpr unsigned kind_mask = 7;
+    // 有回调或者阻塞的等待者，完成时需要加锁
+    static constexpr unsigned slow = 8;
+
+    std::atomic<unsigned> state{ pending };
+
+    std::optional<Result<ResultType>> result;
+
+    std::coroutine_handle<> continuation;
+    AbstractExecutor* continuation_executor = nullptr;
+
+    CompletionHook completion_hook = nullptr;
+    void* hook_context = nullptr;
+
+    std::mutex completion_lock;
+    std::condition_variable completion;
+    std::list<std::function<void(const Result<ResultType>&)>> completion_callbacks;
+
+    static unsigned kind(unsigned value) {
+        return value & kind_mask;
+    }
+
+    // 持有锁时调用，在还没有完成的状态上加 slow 标记，已经完成时返回 false
+    bool mark_slow() {
+        auto current = state.load(std::memory_order_acquire);
+        while (kind(current) != completed) {
+            if ((current & slow) || state.compare_exchange_weak(current, current | slow,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 当前线程就是等待者的调度器时直接切换过去，不再经过调度队列
+    static std::coroutine_handle<> resume(std::coroutine_handle<> handle, AbstractExecutor* handle_executor) noexcept {
+        if (handle_executor->is_in_executor()) {
+            return handle;
+        }
+        handle_executor->schedule(handle);
+        return std::noop_coroutine();
+    }
+};
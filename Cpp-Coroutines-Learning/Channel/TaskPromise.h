@@ -1,13 +1,18 @@
 #pragma once
 #include <functional>
-#include <mutex>
-#include <list>
 #include <optional>
 #include <coroutine>
+#include <type_traits>
 #include "Result.h"
+#include "TaskCompletion.h"
+#include "FramePool.h"
 #include "TaskAwaiter.h"
 #include "SleepAwaiter.h"
 #include "ChannelAwaiter.h"
+#include "TimeoutAwaiter.h"
+#include "SelectAwaiter.h"
+#include "BroadcastChannel.h"
+#include "WhenAll.h"
 
 
 struct DispatchAwaiter {
@@ -18,9 +23,7 @@ struct DispatchAwaiter {
     bool await_ready() const { return false; }
 
     void await_suspend(std::coroutine_handle<> handle) const {
-        _executor->execute([handle]() {
-            handle.resume();
-            });
+        _executor->dispatch(handle);
     }
 
     void await_resume() {}
@@ -29,14 +32,44 @@ private:
     AbstractExecutor* _executor;
 };
 
+// ЭִʱѿȨȴЭ
+// ֪ͨ return_value У֤ȴ߱ʱЭѾ𣬿԰ȫ
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept {
+        return handle.promise().complete();
+    }
+
+    void await_resume() const noexcept {}
+};
+
 template<typename ResultType, typename Executor>
 class Task;
 
 template<typename ResultType, typename Executor>
 struct TaskPromise {
-    DispatchAwaiter initial_suspend() { return DispatchAwaiter{ &executor }; }
+    TaskPromise() : executor(own_executor.emplace().bind()) {}
+
+    // Э̵ĵһǵʱ󶨵ĵϣٴԼĵ
+    template<typename... Args>
+    explicit TaskPromise(AbstractExecutor& shared_executor, Args&...) : executor(shared_executor.bind()) {}
 
-    std::suspend_always final_suspend() noexcept { return {}; }
+#ifndef DISABLE_FRAME_POOL
+    // Э֡ FramePool ̱߳ؿз䣬 DISABLE_FRAME_POOL ʱʹȫֵ operator new
+    static void* operator new(size_t size) {
+        return FramePool::allocate(size);
+    }
+
+    static void operator delete(void* frame, size_t size) noexcept {
+        FramePool::deallocate(frame, size);
+    }
+#endif
+
+    DispatchAwaiter initial_suspend() { return DispatchAwaiter{ executor }; }
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
 
     Task<ResultType, Executor> get_return_object() {
         return Task{ std::coroutine_handle<TaskPromise>::from_promise(*this) };
@@ -44,87 +77,185 @@ struct TaskPromise {
 
     template<typename _ResultType, typename _Executor>
     TaskAwaiter<_ResultType, _Executor> await_transform(Task<_ResultType, _Executor>&& task) {
-        return TaskAwaiter<_ResultType, _Executor>(&executor, std::move(task));
+        return TaskAwaiter<_ResultType, _Executor>(executor, std::move(task));
     }
 
     template<typename _Rep, typename _Period>
     SleepAwaiter await_transform(std::chrono::duration<_Rep, _Period>&& duration) {
-        return SleepAwaiter(&executor, std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+        return SleepAwaiter(executor, std::chrono::ceil<std::chrono::microseconds>(duration));
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(ReaderAwaiter<_ValueType, _Policy> reader_awaiter) {
+        reader_awaiter.executor = executor;
+        return reader_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(WriterAwaiter<_ValueType, _Policy> writer_awaiter) {
+        writer_awaiter.executor = executor;
+        return writer_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(WriteBatchAwaiter<_ValueType, _Policy> writer_awaiter) {
+        writer_awaiter.executor = executor;
+        return writer_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(ReadBatchAwaiter<_ValueType, _Policy> reader_awaiter) {
+        reader_awaiter.executor = executor;
+        return reader_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(ReadIntoAwaiter<_ValueType, _Policy> reader_awaiter) {
+        reader_awaiter.executor = executor;
+        return reader_awaiter;
+    }
+
+    template<typename... _Arms>
+    auto await_transform(SelectAwaiter<_Arms...> select_awaiter) {
+        select_awaiter.executor = executor;
+        return select_awaiter;
     }
 
     template<typename _ValueType>
-    auto await_transform(ReaderAwaiter<_ValueType> reader_awaiter) {
-        reader_awaiter.executor = &executor;
+    auto await_transform(BroadcastReadAwaiter<_ValueType> reader_awaiter) {
+        reader_awaiter.executor = executor;
         return reader_awaiter;
     }
 
     template<typename _ValueType>
-    auto await_transform(WriterAwaiter<_ValueType> writer_awaiter) {
-        writer_awaiter.executor = &executor;
-        return writer_awaiter;
+    auto await_transform(BroadcastPublishAwaiter<_ValueType> publish_awaiter) {
+        publish_awaiter.executor = executor;
+        return publish_awaiter;
+    }
+
+    template<typename... _Tasks>
+    auto await_transform(WhenAllAwaiter<_Tasks...> when_all_awaiter) {
+        when_all_awaiter.executor = executor;
+        return when_all_awaiter;
+    }
+
+    template<typename _ResultType, typename _Executor>
+    auto await_transform(WhenAllRangeAwaiter<_ResultType, _Executor> when_all_awaiter) {
+        when_all_awaiter.executor = executor;
+        return when_all_awaiter;
+    }
+
+    template<typename... _Tasks>
+    auto await_transform(WhenAnyAwaiter<_Tasks...> when_any_awaiter) {
+        when_any_awaiter.executor = executor;
+        return when_any_awaiter;
+    }
+
+    template<typename _Awaitable>
+    auto await_transform(Timeout<_Awaitable>&& timeout) {
+        using InnerAwaiter = decltype(await_transform(std::move(timeout.awaitable)));
+        return TimeoutAwaiter<InnerAwaiter>(executor, timeout.duration, [&]() {
+            return await_transform(std::move(timeout.awaitable));
+            });
     }
 
     void unhandled_exception() {
-        std::lock_guard lock(completion_lock);
-        result = Result<ResultType>(std::current_exception());
-        completion.notify_all();
-        notify_callbacks();
+        completion.set_result(Result<ResultType>(std::current_exception()));
     }
 
     void return_value(ResultType value) {
-        std::lock_guard lock(completion_lock);
-        result = Result<ResultType>(std::move(value));
-        completion.notify_all();
-        notify_callbacks();
+        completion.set_result(Result<ResultType>(std::move(value)));
     }
 
+    // ԸƵĽÿεöһݸֻƶĽֻȡһ
     ResultType get_result() {
         // blocking for result or throw on exception
-        std::unique_lock lock(completion_lock);
-        if (!result.has_value()) {
-            completion.wait(lock);
-        }
-        return result->get_or_throw();
-    }
-
-    void on_completed(std::function<void(Result<ResultType>)>&& func) {
-        std::unique_lock lock(completion_lock);
-        if (result.has_value()) {
-            auto value = result.value();
-            lock.unlock();
-            func(value);
+        if constexpr (std::is_copy_constructible_v<ResultType>) {
+            return completion.wait().get_or_throw();
         }
         else {
-            completion_callbacks.push_back(func);
+            return take_result();
         }
     }
 
-private:
-    std::optional<Result<ResultType>> result;
+    // Ψһĵȴȡֵ߽ƶ
+    ResultType take_result() {
+        return std::move(completion.wait()).get_or_throw();
+    }
 
-    std::mutex completion_lock;
-    std::condition_variable completion;
+    bool is_completed() {
+        return completion.is_completed();
+    }
 
-    std::list<std::function<void(Result<ResultType>)>> completion_callbacks;
+    // ¼ȴǰЭ̣Ѿʱ false
+    bool set_continuation(std::coroutine_handle<> handle, AbstractExecutor* handle_executor) {
+        return completion.set_continuation(handle, handle_executor);
+    }
 
-    Executor executor;
+    // ¼ʱõ hookѾʱ false
+    bool set_hook(CompletionHook hook, void* context) {
+        return completion.set_hook(hook, context);
+    }
+
+    // ȴûнЭ̣Э̽ʱԼ٣Ѿʱ false
+    bool detach() {
+        return completion.detach();
+    }
 
-    void notify_callbacks() {
-        auto value = result.value();
-        for (auto& callback : completion_callbacks) {
-            callback(value);
+    void on_completed(std::function<void(const Result<ResultType>&)>&& func) {
+        completion.on_completed(std::move(func));
+    }
+
+    // ЭѾֹ㣬֪ͨеȴ߲ؽҪִеЭ
+    // ״̬л֮ǰЭʱܱ٣ٷκγԱ
+    std::coroutine_handle<> complete() noexcept {
+        bool detached = false;
+        auto next = completion.complete(detached);
+        if (detached) {
+            auto handle = std::coroutine_handle<TaskPromise>::from_promise(*this);
+            // Э֡дԼĵ߳ٻҪ join ǰ̣߳
+            // ʱһ߳˳ѭ֮
+            if (own_executor && own_executor->is_worker_thread()) {
+                own_executor->reap(handle);
+            }
+            else {
+                handle.destroy();
+            }
         }
-        completion_callbacks.clear();
+        return next;
     }
 
+private:
+    TaskCompletion<ResultType> completion;
+
+    // Эֻ֡ operator new Ĭ϶䣬֡ʱҪĶ
+    static_assert(alignof(Executor) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Executor is over-aligned for a coroutine frame.");
+    std::optional<Executor> own_executor;
+    AbstractExecutor* executor;
+
 };
 
 // voidػ汾
 template<typename Executor>
 struct TaskPromise<void, Executor> {
-    DispatchAwaiter initial_suspend() { return DispatchAwaiter{ &executor }; }
+    TaskPromise() : executor(own_executor.emplace().bind()) {}
+
+    template<typename... Args>
+    explicit TaskPromise(AbstractExecutor& shared_executor, Args&...) : executor(shared_executor.bind()) {}
+
+#ifndef DISABLE_FRAME_POOL
+    static void* operator new(size_t size) {
+        return FramePool::allocate(size);
+    }
+
+    static void operator delete(void* frame, size_t size) noexcept {
+        FramePool::deallocate(frame, size);
+    }
+#endif
 
-    std::suspend_always final_suspend() noexcept { return {}; }
+    DispatchAwaiter initial_suspend() { return DispatchAwaiter{ executor }; }
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
 
     Task<void, Executor> get_return_object() {
         return Task{ std::coroutine_handle<TaskPromise>::from_promise(*this) };
@@ -132,77 +263,146 @@ struct TaskPromise<void, Executor> {
 
     template<typename _ResultType, typename _Executor>
     TaskAwaiter<_ResultType, _Executor> await_transform(Task<_ResultType, _Executor>&& task) {
-        return TaskAwaiter<_ResultType, _Executor>(&executor, std::move(task));
+        return TaskAwaiter<_ResultType, _Executor>(executor, std::move(task));
     }
 
     template<typename _Rep, typename _Period>
     SleepAwaiter await_transform(std::chrono::duration<_Rep, _Period>&& duration) {
-        return SleepAwaiter(&executor, std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+        return SleepAwaiter(executor, std::chrono::ceil<std::chrono::microseconds>(duration));
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(ReaderAwaiter<_ValueType, _Policy> reader_awaiter) {
+        reader_awaiter.executor = executor;
+        return reader_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(WriterAwaiter<_ValueType, _Policy> writer_awaiter) {
+        writer_awaiter.executor = executor;
+        return writer_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(WriteBatchAwaiter<_ValueType, _Policy> writer_awaiter) {
+        writer_awaiter.executor = executor;
+        return writer_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(ReadBatchAwaiter<_ValueType, _Policy> reader_awaiter) {
+        reader_awaiter.executor = executor;
+        return reader_awaiter;
+    }
+
+    template<typename _ValueType, typename _Policy>
+    auto await_transform(ReadIntoAwaiter<_ValueType, _Policy> reader_awaiter) {
+        reader_awaiter.executor = executor;
+        return reader_awaiter;
+    }
+
+    template<typename... _Arms>
+    auto await_transform(SelectAwaiter<_Arms...> select_awaiter) {
+        select_awaiter.executor = executor;
+        return select_awaiter;
     }
 
     template<typename _ValueType>
-    auto await_transform(ReaderAwaiter<_ValueType> reader_awaiter) {
-        reader_awaiter.executor = &executor;
+    auto await_transform(BroadcastReadAwaiter<_ValueType> reader_awaiter) {
+        reader_awaiter.executor = executor;
         return reader_awaiter;
     }
 
     template<typename _ValueType>
-    auto await_transform(WriterAwaiter<_ValueType> writer_awaiter) {
-        writer_awaiter.executor = &executor;
-        return writer_awaiter;
+    auto await_transform(BroadcastPublishAwaiter<_ValueType> publish_awaiter) {
+        publish_awaiter.executor = executor;
+        return publish_awaiter;
+    }
+
+    template<typename... _Tasks>
+    auto await_transform(WhenAllAwaiter<_Tasks...> when_all_awaiter) {
+        when_all_awaiter.executor = executor;
+        return when_all_awaiter;
+    }
+
+    template<typename _ResultType, typename _Executor>
+    auto await_transform(WhenAllRangeAwaiter<_ResultType, _Executor> when_all_awaiter) {
+        when_all_awaiter.executor = executor;
+        return when_all_awaiter;
+    }
+
+    template<typename... _Tasks>
+    auto await_transform(WhenAnyAwaiter<_Tasks...> when_any_awaiter) {
+        when_any_awaiter.executor = executor;
+        return when_any_awaiter;
+    }
+
+    template<typename _Awaitable>
+    auto await_transform(Timeout<_Awaitable>&& timeout) {
+        using InnerAwaiter = decltype(await_transform(std::move(timeout.awaitable)));
+        return TimeoutAwaiter<InnerAwaiter>(executor, timeout.duration, [&]() {
+            return await_transform(std::move(timeout.awaitable));
+            });
     }
 
     void get_result() {
         // blocking for result or throw on exception
-        std::unique_lock lock(completion_lock);
-        if (!result.has_value()) {
-            completion.wait(lock);
-        }
-        result->get_or_throw();
+        completion.wait().get_or_throw();
+    }
+
+    void take_result() {
+        get_result();
     }
 
     void unhandled_exception() {
-        std::lock_guard lock(completion_lock);
-        result = Result<void>(std::current_exception());
-        completion.notify_all();
-        notify_callbacks();
+        completion.set_result(Result<void>(std::current_exception()));
     }
 
     void return_void() {
-        std::lock_guard lock(completion_lock);
-        result = Result<void>();
-        completion.notify_all();
-        notify_callbacks();
-    }
-
-    void on_completed(std::function<void(Result<void>)>&& func) {
-        std::unique_lock lock(completion_lock);
-        if (result.has_value()) {
-            auto value = result.value();
-            lock.unlock();
-            func(value);
-        }
-        else {
-            completion_callbacks.push_back(func);
-        }
+        completion.set_result(Result<void>());
     }
 
-private:
-    std::optional<Result<void>> result;
+    bool is_completed() {
+        return completion.is_completed();
+    }
 
-    std::mutex completion_lock;
-    std::condition_variable completion;
+    bool set_continuation(std::coroutine_handle<> handle, AbstractExecutor* handle_executor) {
+        return completion.set_continuation(handle, handle_executor);
+    }
 
-    std::list<std::function<void(Result<void>)>> completion_callbacks;
+    bool set_hook(CompletionHook hook, void* context) {
+        return completion.set_hook(hook, context);
+    }
 
-    Executor executor;
+    bool detach() {
+        return completion.detach();
+    }
+
+    void on_completed(std::function<void(const Result<void>&)>&& func) {
+        completion.on_completed(std::move(func));
+    }
 
-    void notify_callbacks() {
-        auto value = result.value();
-        for (auto& callback : completion_callbacks) {
-            callback(value);
+    std::coroutine_handle<> complete() noexcept {
+        bool detached = false;
+        auto next = completion.complete(detached);
+        if (detached) {
+            auto handle = std::coroutine_handle<TaskPromise>::from_promise(*this);
+            if (own_executor && own_executor->is_worker_thread()) {
+                own_executor->reap(handle);
+            }
+            else {
+                handle.destroy();
+            }
         }
-        completion_callbacks.clear();
+        return next;
     }
 
+private:
+    TaskCompletion<void> completion;
+
+    // Эֻ֡ operator new Ĭ϶䣬֡ʱҪĶ
+    static_assert(alignof(Executor) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Executor is over-aligned for a coroutine frame.");
+    std::optional<Executor> own_executor;
+    AbstractExecutor* executor;
+
 };
@@ -0,0 +1,132 @@
+#pragma once
+#include <coroutine>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include "Executor.h"
+
+// with_timeout 的参数，由 TaskPromise::await_transform 转换成 TimeoutAwaiter
+template<typename Awaitable>
+struct Timeout {
+    Awaitable awaitable;
+    std::chrono::microseconds duration;
+};
+
+template<typename Awaitable, typename _Rep, typename _Period>
+auto with_timeout(Awaitable&& awaitable, std::chrono::duration<_Rep, _Period> duration) {
+    return Timeout<std::decay_t<Awaitable>>{ std::forward<Awaitable>(awaitable),
+        std::chrono::ceil<std::chrono::microseconds>(duration) };
+}
+
+// 给一个可以撤销的等待加上超时，内部的 awaiter 需要提供 cancel()：
+// 还没有完成时把自己撤出等待，返回 true 之后不会再恢复协程
+// 超时返回 std::nullopt，内部的结果为 void 时返回是否按时完成
+template<typename Awaiter>
+struct TimeoutAwaiter {
+private:
+    // 定时器回调和等待的协程共享，回调可能在协程结束等待之后才执行
+    struct TimeoutState {
+        std::mutex lock;
+        // 协程已经结束等待，定时器回调不能再访问 awaiter
+        bool finished = false;
+        bool timed_out = false;
+        TimerHandle timer;
+    };
+
+    using InnerResult = decltype(std::declval<Awaiter>().await_resume());
+
+public:
+    template<typename MakeAwaiter>
+    TimeoutAwaiter(AbstractExecutor* executor, std::chrono::microseconds duration, MakeAwaiter&& make_awaiter)
+        : awaiter(make_awaiter()), _executor(executor), _duration(duration) {}
+
+    TimeoutAwaiter(TimeoutAwaiter&) = delete;
+
+    TimeoutAwaiter& operator=(TimeoutAwaiter&) = delete;
+
+    // 协程在等待期间被销毁时，让还没有执行的定时器回调不再访问 awaiter
+    ~TimeoutAwaiter() {
+        if (state) {
+            std::lock_guard lock(state->lock);
+            state->finished = true;
+            state->timer.cancel();
+        }
+    }
+
+    bool await_ready() {
+        return awaiter.await_ready();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        auto state = std::make_shared<TimeoutState>();
+        this->state = state;
+        // 定时器在持有锁时设置，回调一定在内部 awaiter 挂起之后才会检查状态
+        std::lock_guard lock(state->lock);
+        if (!suspend_awaiter(handle)) {
+            return false;
+        }
+        auto executor = _executor;
+        state->timer = executor->execute_after([this, state, executor, handle]() {
+            std::unique_lock lock(state->lock);
+            // 内部的等待已经完成，恢复协程的是完成的一方
+            if (state->finished || !awaiter.cancel()) {
+                return;
+            }
+            state->finished = true;
+            state->timed_out = true;
+            lock.unlock();
+            executor->dispatch(handle);
+            }, _duration);
+        return true;
+    }
+
+    auto await_resume() {
+        if (state) {
+            std::lock_guard lock(state->lock);
+            state->finished = true;
+            state->timer.cancel();
+        }
+        bool timed_out = state && state->timed_out;
+        if constexpr (std::is_void_v<InnerResult>) {
+            if (timed_out) {
+                return false;
+            }
+            awaiter.await_resume();
+            return true;
+        }
+        else {
+            if (timed_out) {
+                return std::optional<std::decay_t<InnerResult>>();
+            }
+            return std::optional<std::decay_t<InnerResult>>(awaiter.await_resume());
+        }
+    }
+
+private:
+    Awaiter awaiter;
+    AbstractExecutor* _executor;
+    std::chrono::microseconds _duration;
+    std::shared_ptr<TimeoutState> state;
+
+    // 统一内部 awaiter 三种 await_suspend 的返回值，返回 true 表示协程已经挂起
+    bool suspend_awaiter(std::coroutine_handle<> handle) {
+        using SuspendResult = decltype(awaiter.await_suspend(handle));
+        if constexpr (std::is_void_v<SuspendResult>) {
+            awaiter.await_suspend(handle);
+            return true;
+        }
+        else if constexpr (std::is_same_v<SuspendResult, bool>) {
+            return awaiter.await_suspend(handle);
+        }
+        else {
+            // 返回自身句柄表示不需要挂起，其他句柄不在这里恢复
+            auto next = awaiter.await_suspend(handle);
+            if (next == handle) {
+                return false;
+            }
+            next.resume();
+            return true;
+        }
+    }
+};
@@ -0,0 +1,229 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <optional>
+#include <algorithm>
+
+#include "Scheduler.h"
+
+// 分层时间轮，精度为 1ms，定时器的微秒时间向上取整到 tick，保证不会提前执行
+// 第 0 层 256 个槽，每个槽 1ms；之后 4 层各 64 个槽，每个槽的跨度是上一层整圈的长度
+// 插入和取消都是 O(1)，每个 tick 把到期槽位中的定时器整体取出
+class TimingWheel {
+private:
+    static constexpr int root_bits = 8;
+    static constexpr int level_bits = 6;
+    static constexpr int level_count = 4;
+    static constexpr long long root_size = 1LL << root_bits;
+    static constexpr long long level_size = 1LL << level_bits;
+    static constexpr long long tick_micros = 1000;
+    static constexpr long long max_delta = 1LL << (root_bits + level_bits * level_count);
+
+    struct Node {
+        std::optional<DelayedExecutable> executable;
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        // 所在槽位的链表头，用于 O(1) 摘除
+        Node** slot = nullptr;
+        unsigned index = 0;
+        // 只使用低 31 位，定时器 id 的最高位留给组合使用的定时器队列区分来源
+        unsigned generation = 0;
+    };
+
+    Node* root[root_size] = {};
+    Node* levels[level_count][level_size] = {};
+    // 插入时已经到期的定时器
+    Node* ready = nullptr;
+
+    // 节点只分配一次，之后通过空闲列表复用
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<unsigned> free_nodes;
+
+    // 已经处理过的最后一个 tick
+    long long current_tick;
+    size_t count = 0;
+
+    static void link(Node** slot, Node* node) {
+        node->slot = slot;
+        node->prev = nullptr;
+        node->next = *slot;
+        if (*slot) {
+            (*slot)->prev = node;
+        }
+        *slot = node;
+    }
+
+    static void unlink(Node* node) {
+        if (node->prev) {
+            node->prev->next = node->next;
+        }
+        else {
+            *node->slot = node->next;
+        }
+        if (node->next) {
+            node->next->prev = node->prev;
+        }
+        node->slot = nullptr;
+    }
+
+    Node* allocate() {
+        if (free_nodes.empty()) {
+            nodes.push_back(std::make_unique<Node>());
+            nodes.back()->index = static_cast<unsigned>(nodes.size() - 1);
+            return nodes.back().get();
+        }
+        auto node = nodes[free_nodes.back()].get();
+        free_nodes.pop_back();
+        return node;
+    }
+
+    void release(Node* node) {
+        node->executable.reset();
+        node->generation = (node->generation + 1) & 0x7fffffff;
+        free_nodes.push_back(node->index);
+        count--;
+    }
+
+    static long long to_tick(long long time) {
+        return (time + tick_micros - 1) / tick_micros;
+    }
+
+    void place(Node* node) {
+        auto time = to_tick(node->executable->get_scheduled_time());
+        if (time <= current_tick) {
+            link(&ready, node);
+            return;
+        }
+        auto delta = time - current_tick;
+        if (delta < root_size) {
+            link(&root[time & (root_size - 1)], node);
+            return;
+        }
+        if (delta >= max_delta) {
+            // 超出时间轮范围的先放在最高层，转到那里时再重新放置
+            time = current_tick + max_delta - 1;
+            delta = max_delta - 1;
+        }
+        for (int level = 0; level < level_count; level++) {
+            int shift = root_bits + level_bits * level;
+            if (delta < (1LL << (shift + level_bits))) {
+                link(&levels[level][(time >> shift) & (level_size - 1)], node);
+                return;
+            }
+        }
+    }
+
+    // 把上层槽位中的定时器按剩余时间重新放到下层
+    void cascade(int level) {
+        int shift = root_bits + level_bits * level;
+        auto& slot = levels[level][(current_tick >> shift) & (level_size - 1)];
+        auto node = slot;
+        slot = nullptr;
+        while (node) {
+            auto next = node->next;
+            place(node);
+            node = next;
+        }
+    }
+
+    void collect(Node*& slot, std::vector<DelayedExecutable>& expired) {
+        auto node = slot;
+        slot = nullptr;
+        while (node) {
+            auto next = node->next;
+            node->slot = nullptr;
+            expired.push_back(std::move(*node->executable));
+            release(node);
+            node = next;
+        }
+    }
+
+public:
+
+    TimingWheel() : current_tick(current_time_micros() / tick_micros) {}
+
+    TimingWheel(TimingWheel&) = delete;
+
+    TimingWheel& operator=(TimingWheel&) = delete;
+
+    TimerId push(DelayedExecutable&& executable) {
+        if (count == 0) {
+            // 空闲期间不再逐个 tick 推进，直接跳到当前时间
+            current_tick = std::max(current_tick, current_time_micros() / tick_micros);
+        }
+        auto node = allocate();
+        auto id = (static_cast<TimerId>(node->generation) << 32) | node->index;
+        executable.set_id(id);
+        node->executable.emplace(std::move(executable));
+        place(node);
+        count++;
+        return id;
+    }
+
+    bool cancel(TimerId id) {
+        auto index = static_cast<unsigned>(id & 0xffffffff);
+        auto generation = static_cast<unsigned>(id >> 32);
+        if (index >= nodes.size()) {
+            return false;
+        }
+        auto node = nodes[index].get();
+        if (node->generation != generation || !node->slot) {
+            return false;
+        }
+        unlink(node);
+        release(node);
+        return true;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // 最早可能有定时器到期的时间：下一个非空的第 0 层槽位，或者下一次向下层转移的时间
+    long long next_time() const {
+        if (ready) {
+            return current_tick * tick_micros;
+        }
+        for (auto tick = current_tick + 1; ; tick++) {
+            if (root[tick & (root_size - 1)] || (tick & (root_size - 1)) == 0) {
+                return tick * tick_micros;
+            }
+        }
+    }
+
+    void pop_expired(long long now_micros, std::vector<DelayedExecutable>& expired) {
+        auto now = now_micros / tick_micros;
+        collect(ready, expired);
+        while (current_tick < now) {
+            if (count == 0) {
+                current_tick = now;
+                break;
+            }
+            current_tick++;
+            if ((current_tick & (root_size - 1)) == 0) {
+                for (int level = 0; level < level_count; level++) {
+                    cascade(level);
+                    if (((current_tick >> (root_bits + level_bits * level)) & (level_size - 1)) != 0) {
+                        break;
+                    }
+                }
+                collect(ready, expired);
+            }
+            collect(root[current_tick & (root_size - 1)], expired);
+        }
+    }
+
+    void clear() {
+        for (auto& node : nodes) {
+            if (node->slot) {
+                node->slot = nullptr;
+                release(node.get());
+            }
+        }
+        std::fill(std::begin(root), std::end(root), nullptr);
+        for (auto& level : levels) {
+            std::fill(std::begin(level), std::end(level), nullptr);
+        }
+        ready = nullptr;
+    }
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+
+template<typename T>
+class WaiterList;
+
+template<typename T>
+class WakeList;
+
+// 嵌在 awaiter 中的链表节点，挂起和撤出都不需要分配内存
+// 节点只在持有 Channel 的锁时修改，owner 记录它当前所在的等待列表
+class WaiterNode {
+public:
+    WaiterNode() = default;
+
+    // awaiter 移动时新对象还没有挂起，不继承链表中的位置
+    WaiterNode(WaiterNode&) = delete;
+
+    WaiterNode& operator=(WaiterNode&) = delete;
+
+private:
+    template<typename T>
+    friend class WaiterList;
+
+    template<typename T>
+    friend class WakeList;
+
+    WaiterNode* prev = nullptr;
+    WaiterNode* next = nullptr;
+    const void* owner = nullptr;
+};
+
+// 侵入式的双向链表，push_back、pop_front 和 remove 都是 O(1)
+// T 需要继承 WaiterNode
+template<typename T>
+class WaiterList {
+private:
+    WaiterNode* head = nullptr;
+    WaiterNode* tail = nullptr;
+    size_t count = 0;
+
+public:
+
+    WaiterList() = default;
+
+    WaiterList(WaiterList&) = delete;
+
+    WaiterList& operator=(WaiterList&) = delete;
+
+    bool empty() const {
+        return head == nullptr;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    T* front() const {
+        return static_cast<T*>(head);
+    }
+
+    // 遍历时使用，waiter 必须在当前列表中
+    T* next(T* waiter) const {
+        return static_cast<T*>(static_cast<WaiterNode*>(waiter)->next);
+    }
+
+    void push_back(T* waiter) {
+        WaiterNode* node = waiter;
+        node->owner = this;
+        node->prev = tail;
+        node->next = nullptr;
+        if (tail) {
+            tail->next = node;
+        }
+        else {
+            head = node;
+        }
+        tail = node;
+        count++;
+    }
+
+    T* pop_front() {
+        auto node = head;
+        if (node) {
+            unlink(node);
+        }
+        return static_cast<T*>(node);
+    }
+
+    // 节点不在当前列表中时返回 false，已经被取出等待恢复的节点也不在任何列表中
+    bool remove(T* waiter) {
+        WaiterNode* node = waiter;
+        if (node->owner != this) {
+            return false;
+        }
+        unlink(node);
+        return true;
+    }
+
+private:
+    void unlink(WaiterNode* node) {
+        if (node->prev) {
+            node->prev->next = node->next;
+        }
+        else {
+            head = node->next;
+        }
+        if (node->next) {
+            node->next->prev = node->prev;
+        }
+        else {
+            tail = node->prev;
+        }
+        node->prev = nullptr;
+        node->next = nullptr;
+        node->owner = nullptr;
+        count--;
+    }
+};
+
+// 持有锁时从 WaiterList 中取出、释放锁之后再恢复的等待者，只用 next 串成单链表
+// 节点已经不属于任何列表，撤出操作不会再访问它们
+template<typename T>
+class WakeList {
+private:
+    WaiterNode* head = nullptr;
+    WaiterNode* tail = nullptr;
+    size_t count = 0;
+
+public:
+
+    WakeList() = default;
+
+    WakeList(WakeList&) = delete;
+
+    WakeList& operator=(WakeList&) = delete;
+
+    bool empty() const {
+        return head == nullptr;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    void push_back(T* waiter) {
+        WaiterNode* node = waiter;
+        node->next = nullptr;
+        if (tail) {
+            tail->next = node;
+        }
+        else {
+            head = node;
+        }
+        tail = node;
+        count++;
+    }
+
+    // 恢复之后等待者可能被销毁或者重新挂起，先取出下一个节点
+    void resume_all() {
+        auto node = head;
+        head = tail = nullptr;
+        count = 0;
+        while (node) {
+            auto next = node->next;
+            static_cast<T*>(node)->resume();
+            node = next;
+        }
+    }
+};
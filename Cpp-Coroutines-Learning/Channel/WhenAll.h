@@ -0,0 +1,391 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "Executor.h"
+
+template<typename ResultType, typename Executor>
+struct Task;
+
+template<typename T>
+struct TaskTraits;
+
+template<typename ResultType, typename Executor>
+struct TaskTraits<Task<ResultType, Executor>> {
+    using result_type = ResultType;
+    using executor_type = Executor;
+    // 组合结果中的元素，void 的任务用 std::monostate 占位
+    using value_type = std::conditional_t<std::is_void_v<ResultType>, std::monostate, ResultType>;
+};
+
+template<typename T>
+concept TaskType = requires { typename TaskTraits<std::decay_t<T>>::result_type; };
+
+// 任务在创建时就已经开始执行，组合只负责一起等待它们
+// 每个子任务登记一个 hook，完成时在完成的线程上减少计数，登记和通知都不加锁也不分配内存
+// hook 在子任务的终止点上执行，最后一个完成的子任务把等待的协程交给调度队列恢复，不在子任务的栈上继续
+// hook 调用之后子任务不再访问自己的协程帧，等待的协程恢复之后可以直接取出结果并销毁子任务
+
+// when_all 的 hook 和等待的协程共享的状态，每个登记了 hook 的任务和 awaiter 各持有一个引用，最后一个引用释放时销毁
+// 等待的协程在等待期间被销毁时，还没有结束的任务会被放弃，已经在执行的 hook 仍然可以安全地访问这个状态
+struct WhenAllState {
+    // 多出来的一个计数属于登记 hook 的线程，登记期间全部完成时由它直接继续
+    std::atomic<size_t> remaining{ 0 };
+    std::atomic<size_t> references{ 0 };
+    std::coroutine_handle<> handle;
+    AbstractExecutor* executor = nullptr;
+
+    static WhenAllState* create(size_t count, std::coroutine_handle<> handle, AbstractExecutor* executor) {
+        auto state = new WhenAllState();
+        state->remaining.store(count + 1, std::memory_order_relaxed);
+        state->references.store(count + 1, std::memory_order_relaxed);
+        state->handle = handle;
+        state->executor = executor;
+        return state;
+    }
+
+    static void release(WhenAllState* state) {
+        if (state->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete state;
+        }
+    }
+
+    // 返回 true 表示最后一个到达
+    bool arrive() {
+        return remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    static void on_task_completed(void* context) {
+        auto state = static_cast<WhenAllState*>(context);
+        if (state->arrive()) {
+            state->executor->schedule(state->handle);
+        }
+        release(state);
+    }
+
+    // 已经完成的任务不会再调用 hook，由登记的线程替它到达
+    template<typename Task>
+    void attach(Task& task) {
+        if (!task.handle.promise().set_hook(&WhenAllState::on_task_completed, this)) {
+            arrive();
+            release(this);
+        }
+    }
+
+    // 等待的协程在等待期间被销毁时调用
+    // 先占住一个计数，之后到达的 hook 都不会再恢复协程
+    void block() {
+        remaining.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // 还没有结束的任务不会再调用 hook，替它释放引用，结束时自己销毁
+    // 已经结束的任务随 Task 一起销毁，在此之前等完成的一方离开临界区
+    template<typename Task>
+    void abandon(Task& task) {
+        if (!task.handle) {
+            return;
+        }
+        if (task.handle.promise().detach()) {
+            task.handle = nullptr;
+            release(this);
+        }
+        else {
+            task.handle.promise().is_completed();
+        }
+    }
+};
+
+// 等待所有任务完成，按参数顺序返回结果组成的 tuple，有任务抛出异常时重新抛出位置最靠前的那一个
+template<typename... Tasks>
+struct WhenAllAwaiter {
+    using ResultType = std::tuple<typename TaskTraits<Tasks>::value_type...>;
+
+    AbstractExecutor* executor = nullptr;
+
+    explicit WhenAllAwaiter(Tasks&&... tasks) : tasks(std::move(tasks)...) {}
+
+    WhenAllAwaiter(WhenAllAwaiter&& other) noexcept
+        : executor(other.executor), tasks(std::move(other.tasks)), state(std::exchange(other.state, nullptr)) {}
+
+    WhenAllAwaiter(WhenAllAwaiter&) = delete;
+
+    WhenAllAwaiter& operator=(WhenAllAwaiter&) = delete;
+
+    ~WhenAllAwaiter() {
+        if (!state) {
+            return;
+        }
+        if (!resumed) {
+            state->block();
+            std::apply([this](auto&... task) { (state->abandon(task), ...); }, tasks);
+        }
+        WhenAllState::release(state);
+    }
+
+    bool await_ready() const {
+        return sizeof...(Tasks) == 0;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state = WhenAllState::create(sizeof...(Tasks), handle, executor);
+        std::apply([this](auto&... task) { (state->attach(task), ...); }, tasks);
+        return !state->arrive();
+    }
+
+    ResultType await_resume() {
+        resumed = true;
+        return std::apply([](auto&... task) { return ResultType{ take(task)... }; }, tasks);
+    }
+
+private:
+    std::tuple<Tasks...> tasks;
+    WhenAllState* state = nullptr;
+    bool resumed = false;
+
+    template<typename Task>
+    static auto take(Task& task) {
+        if constexpr (std::is_void_v<typename TaskTraits<Task>::result_type>) {
+            task.handle.promise().take_result();
+            return std::monostate{};
+        }
+        else {
+            return task.handle.promise().take_result();
+        }
+    }
+};
+
+// 等待一组同类型的任务，结果按原来的顺序放在 vector 中，任务没有返回值时 co_await 也没有返回值
+template<typename ResultType, typename Executor>
+struct WhenAllRangeAwaiter {
+    AbstractExecutor* executor = nullptr;
+
+    explicit WhenAllRangeAwaiter(std::vector<Task<ResultType, Executor>>&& tasks) : tasks(std::move(tasks)) {}
+
+    WhenAllRangeAwaiter(WhenAllRangeAwaiter&& other) noexcept
+        : executor(other.executor), tasks(std::move(other.tasks)), state(std::exchange(other.state, nullptr)) {}
+
+    WhenAllRangeAwaiter(WhenAllRangeAwaiter&) = delete;
+
+    WhenAllRangeAwaiter& operator=(WhenAllRangeAwaiter&) = delete;
+
+    ~WhenAllRangeAwaiter() {
+        if (!state) {
+            return;
+        }
+        if (!resumed) {
+            state->block();
+            for (auto& task : tasks) {
+                state->abandon(task);
+            }
+        }
+        WhenAllState::release(state);
+    }
+
+    bool await_ready() const {
+        return tasks.empty();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state = WhenAllState::create(tasks.size(), handle, executor);
+        for (auto& task : tasks) {
+            state->attach(task);
+        }
+        return !state->arrive();
+    }
+
+    auto await_resume() {
+        resumed = true;
+        if constexpr (std::is_void_v<ResultType>) {
+            for (auto& task : tasks) {
+                task.handle.promise().take_result();
+            }
+        }
+        else {
+            std::vector<ResultType> results;
+            results.reserve(tasks.size());
+            for (auto& task : tasks) {
+                results.push_back(task.handle.promise().take_result());
+            }
+            return results;
+        }
+    }
+
+private:
+    std::vector<Task<ResultType, Executor>> tasks;
+    WhenAllState* state = nullptr;
+    bool resumed = false;
+};
+
+// 等待最先完成的任务，返回的 variant 的下标就是它的位置，它抛出的异常会重新抛出
+// 其余的任务不再等待，继续执行到结束时自己销毁
+template<typename... Tasks>
+struct WhenAnyAwaiter {
+    using ResultType = std::variant<typename TaskTraits<Tasks>::value_type...>;
+
+    AbstractExecutor* executor = nullptr;
+
+    explicit WhenAnyAwaiter(Tasks&&... tasks) : tasks(std::move(tasks)...) {}
+
+    WhenAnyAwaiter(WhenAnyAwaiter&& other) noexcept
+        : executor(other.executor), tasks(std::move(other.tasks)), state(std::exchange(other.state, nullptr)) {}
+
+    WhenAnyAwaiter(WhenAnyAwaiter&) = delete;
+
+    WhenAnyAwaiter& operator=(WhenAnyAwaiter&) = delete;
+
+    ~WhenAnyAwaiter() {
+        if (!state) {
+            return;
+        }
+        // 协程在等待期间被销毁时，所有任务都按落选处理，之后到达的 hook 也不会再恢复协程
+        if (!resumed) {
+            state->arrivals.fetch_add(1, std::memory_order_acq_rel);
+            for_each_task([this](auto& task) { abandon(task); }, std::index_sequence_for<Tasks...>());
+        }
+        release(state);
+    }
+
+    bool await_ready() const {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state = new State();
+        // 每个任务的 hook 和当前的 awaiter 各持有一个引用
+        state->references.store(static_cast<int>(sizeof...(Tasks)) + 1, std::memory_order_relaxed);
+        state->handle = handle;
+        state->executor = executor;
+        register_tasks(std::index_sequence_for<Tasks...>());
+        // 胜出的任务可能在登记期间就已经完成，这时由当前线程直接继续
+        return state->arrivals.fetch_add(1, std::memory_order_acq_rel) == 0;
+    }
+
+    ResultType await_resume() {
+        resumed = true;
+        auto index = state->winner.load(std::memory_order_acquire);
+        std::optional<ResultType> result;
+        std::exception_ptr exception;
+        finish(index, result, exception, std::index_sequence_for<Tasks...>());
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*result);
+    }
+
+private:
+    // hook 可能在当前协程结束等待之后才执行，和它共享这个状态，最后一个引用释放时销毁
+    struct State {
+        std::atomic<int> winner{ -1 };
+        // 胜出的任务和登记完成的当前线程各到达一次，后到的一方恢复协程
+        std::atomic<int> arrivals{ 0 };
+        std::atomic<int> references{ 0 };
+        std::coroutine_handle<> handle;
+        AbstractExecutor* executor = nullptr;
+    };
+
+    std::tuple<Tasks...> tasks;
+    State* state = nullptr;
+    bool resumed = false;
+
+    static void release(State* state) {
+        if (state->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete state;
+        }
+    }
+
+    template<size_t I>
+    static void on_task_completed(void* context) {
+        auto state = static_cast<State*>(context);
+        int expect = -1;
+        if (state->winner.compare_exchange_strong(expect, static_cast<int>(I), std::memory_order_acq_rel)
+            && state->arrivals.fetch_add(1, std::memory_order_acq_rel) == 1) {
+            state->executor->schedule(state->handle);
+        }
+        release(state);
+    }
+
+    template<size_t... I>
+    void register_tasks(std::index_sequence<I...>) {
+        // 已经完成的任务不会再调用 hook，当场参与竞争
+        ((std::get<I>(tasks).handle.promise().set_hook(&on_task_completed<I>, state)
+            ? void() : on_task_completed<I>(state)), ...);
+    }
+
+    template<typename Func, size_t... I>
+    void for_each_task(Func&& func, std::index_sequence<I...>) {
+        (func(std::get<I>(tasks)), ...);
+    }
+
+    // 放弃落选的任务：还没有结束的任务不会再调用 hook，替它释放引用，结束时自己销毁
+    // 已经结束的任务随 Task 一起销毁，在此之前等完成的一方离开临界区
+    template<typename Task>
+    void abandon(Task& task) {
+        if (!task.handle) {
+            return;
+        }
+        if (task.handle.promise().detach()) {
+            task.handle = nullptr;
+            release(state);
+        }
+        else {
+            task.handle.promise().is_completed();
+        }
+    }
+
+    template<size_t... I>
+    void finish(int index, std::optional<ResultType>& result, std::exception_ptr& exception, std::index_sequence<I...>) {
+        (finish_task<I>(index == static_cast<int>(I), std::get<I>(tasks), result, exception), ...);
+    }
+
+    template<size_t I, typename Task>
+    void finish_task(bool won, Task& task, std::optional<ResultType>& result, std::exception_ptr& exception) {
+        if (!won) {
+            abandon(task);
+            return;
+        }
+        try {
+            if constexpr (std::is_void_v<typename TaskTraits<Task>::result_type>) {
+                task.handle.promise().take_result();
+                result.emplace(std::in_place_index<I>);
+            }
+            else {
+                result.emplace(std::in_place_index<I>, task.handle.promise().take_result());
+            }
+        }
+        catch (...) {
+            exception = std::current_exception();
+        }
+    }
+};
+
+template<typename... Tasks>
+    requires (TaskType<Tasks> && ...)
+auto when_all(Tasks&&... tasks) {
+    return WhenAllAwaiter<std::decay_t<Tasks>...>(std::move(tasks)...);
+}
+
+// range 中的任务被移动到 awaiter 中
+template<typename Range>
+    requires (!TaskType<Range>)
+auto when_all(Range&& range) {
+    using TaskOf = std::decay_t<decltype(*std::begin(range))>;
+    std::vector<TaskOf> tasks;
+    for (auto& task : range) {
+        tasks.push_back(std::move(task));
+    }
+    return WhenAllRangeAwaiter<typename TaskTraits<TaskOf>::result_type,
+        typename TaskTraits<TaskOf>::executor_type>(std::move(tasks));
+}
+
+template<typename... Tasks>
+    requires (TaskType<Tasks> && ...)
+auto when_any(Tasks&&... tasks) {
+    return WhenAnyAwaiter<std::decay_t<Tasks>...>(std::move(tasks)...);
+}